@@ -0,0 +1,346 @@
+// Headless benchmark of the csv reader: generates a synthetic csv/tsv file (or uses an existing one)
+// and times every phase of a load without ManiVault or a gui.
+//
+// usage: CsvLoaderBenchmark [options]
+//   --file <path>            benchmark an existing file instead of generating one
+//   --output <path>          name of the generated file (default csvbenchmark.csv)
+//   --rows <n>               number of generated rows (default 100000)
+//   --columns <n>            number of generated columns (default 100)
+//   --categorical <n>        number of those columns that are categorical (default 0)
+//   --levels <n>             number of distinct values per categorical column (default 20)
+//   --quoted <fraction>      fraction of the cells that is quoted (default 0)
+//   --zeros <fraction>       fraction of the numerical cells that is zero (default 0)
+//   --tsv                    use tabs instead of commas
+//   --no-column-header       the file has no column header
+//   --no-row-header          the file has no row header
+//   --bfloat16               parse numbers into bfloat16 instead of float
+//   --storage <type>         float, bfloat16, int8, uint8, int16, uint16, int32, scaled8, scaled16 or integral (default float)
+//   --integers               generate integer counts instead of decimals
+//   --transform <type>       none, log, sqrt or arcsinh, applied while parsing (default none)
+//   --normalization <type>   none, zscore or minmax, applied in the storage phase (default none)
+//   --repeat <n>             number of times every phase is run, the fastest run is reported (default 3)
+//   --keep                   keep the generated file
+
+#include "csvcolumns.h"
+#include "csvreader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+	struct Options
+	{
+		std::string file;
+		std::string output = "csvbenchmark.csv";
+		std::size_t rows = 100000;
+		std::size_t columns = 100;
+		std::size_t categorical = 0;
+		std::size_t levels = 20;
+		double quoted = 0.0;
+		double zeros = 0.0;
+		char separator = ',';
+		bool column_header = true;
+		bool row_header = true;
+		std::string storage = "float";
+		bool integers = false;
+		std::string transform = "none";
+		std::string normalization = "none";
+		int repeat = 3;
+		bool keep = false;
+	};
+
+	bool parse_options(int argc, char* argv[], Options& options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			auto next = [&]() -> const char*
+			{
+				if (i + 1 >= argc)
+				{
+					std::fprintf(stderr, "missing value for %s\n", arg.c_str());
+					std::exit(EXIT_FAILURE);
+				}
+				return argv[++i];
+			};
+
+			if (arg == "--file")
+				options.file = next();
+			else if (arg == "--output")
+				options.output = next();
+			else if (arg == "--rows")
+				options.rows = std::strtoull(next(), nullptr, 10);
+			else if (arg == "--columns")
+				options.columns = std::strtoull(next(), nullptr, 10);
+			else if (arg == "--categorical")
+				options.categorical = std::strtoull(next(), nullptr, 10);
+			else if (arg == "--levels")
+				options.levels = std::max<std::size_t>(1, std::strtoull(next(), nullptr, 10));
+			else if (arg == "--quoted")
+				options.quoted = std::atof(next());
+			else if (arg == "--zeros")
+				options.zeros = std::atof(next());
+			else if (arg == "--tsv")
+				options.separator = '\t';
+			else if (arg == "--no-column-header")
+				options.column_header = false;
+			else if (arg == "--no-row-header")
+				options.row_header = false;
+			else if (arg == "--bfloat16")
+				options.storage = "bfloat16";
+			else if (arg == "--storage")
+				options.storage = next();
+			else if (arg == "--integers")
+				options.integers = true;
+			else if (arg == "--transform")
+				options.transform = next();
+			else if (arg == "--normalization")
+				options.normalization = next();
+			else if (arg == "--repeat")
+				options.repeat = std::max(1, std::atoi(next()));
+			else if (arg == "--keep")
+				options.keep = true;
+			else
+			{
+				std::fprintf(stderr, "unknown option %s\n", arg.c_str());
+				return false;
+			}
+		}
+		options.categorical = std::min(options.categorical, options.columns);
+		return true;
+	}
+
+	// the categorical columns are spread evenly over the file
+	bool is_categorical(const Options& options, const std::size_t column)
+	{
+		return options.categorical && ((column * options.categorical) % options.columns) < options.categorical;
+	}
+
+	bool generate(const Options& options)
+	{
+		std::ofstream out(options.output, std::ios::binary);
+		if (!out)
+			return false;
+
+		std::mt19937_64 rng(42);
+		std::uniform_real_distribution<double> number(-1000.0, 1000.0);
+		std::uniform_int_distribution<std::size_t> level(0, options.levels - 1);
+		std::bernoulli_distribution quote(std::clamp(options.quoted, 0.0, 1.0));
+		std::bernoulli_distribution zero(std::clamp(options.zeros, 0.0, 1.0));
+
+		std::string line;
+		char cell[64];
+		auto add = [&](const char* text, const std::size_t length)
+		{
+			if (quote(rng))
+			{
+				line += '"';
+				line.append(text, length);
+				line += '"';
+			}
+			else
+			{
+				line.append(text, length);
+			}
+		};
+
+		if (options.column_header)
+		{
+			if (options.row_header)
+				line += "id";
+			for (std::size_t column = 0; column < options.columns; ++column)
+			{
+				if (options.row_header || column)
+					line += options.separator;
+				add(cell, std::snprintf(cell, sizeof(cell), "%s%zu", is_categorical(options, column) ? "label" : "dim", column));
+			}
+			line += '\n';
+			out << line;
+		}
+
+		for (std::size_t row = 0; row < options.rows; ++row)
+		{
+			line.clear();
+			if (options.row_header)
+				add(cell, std::snprintf(cell, sizeof(cell), "cell%zu", row));
+			for (std::size_t column = 0; column < options.columns; ++column)
+			{
+				if (options.row_header || column)
+					line += options.separator;
+				if (is_categorical(options, column))
+					add(cell, std::snprintf(cell, sizeof(cell), "type_%zu", level(rng)));
+				else if (zero(rng))
+					add("0", 1);
+				else
+					add(cell, options.integers ? std::snprintf(cell, sizeof(cell), "%d", int(std::abs(number(rng))) % 200) : std::snprintf(cell, sizeof(cell), "%.4f", number(rng)));
+			}
+			line += '\n';
+			out << line;
+		}
+		return bool(out);
+	}
+
+	// runs f repeat times and returns the fastest time in seconds
+	double time_phase(const int repeat, const std::function<void()>& f)
+	{
+		double best = std::numeric_limits<double>::max();
+		for (int i = 0; i < repeat; ++i)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			f();
+			const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			best = std::min(best, elapsed.count());
+		}
+		return best;
+	}
+
+	void report(const char* phase, const double seconds, const double megabytes, const std::size_t rows)
+	{
+		std::printf("%-16s %10.3f s %10.1f MB/s %14.0f rows/s\n", phase, seconds, megabytes / seconds, double(rows) / seconds);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	using namespace ExtCsvLoader;
+
+	Options options;
+	if (!parse_options(argc, argv, options))
+		return EXIT_FAILURE;
+
+	std::string filename = options.file;
+	if (filename.empty())
+	{
+		filename = options.output;
+		std::printf("generating %zu x %zu (%zu categorical) in %s\n", options.rows, options.columns, options.categorical, filename.c_str());
+		if (!generate(options))
+		{
+			std::fprintf(stderr, "could not write %s\n", filename.c_str());
+			return EXIT_FAILURE;
+		}
+	}
+
+	const QString qfilename = QString::fromStdString(filename);
+	const double megabytes = double(std::filesystem::file_size(filename)) / (1024.0 * 1024.0);
+	const std::vector<std::string> storageNames = { "float", "bfloat16", "int8", "uint8", "int16", "uint16", "int32", "scaled8", "scaled16", "integral" };
+	const auto storageName = std::find(storageNames.cbegin(), storageNames.cend(), options.storage);
+	if (storageName == storageNames.cend())
+	{
+		std::fprintf(stderr, "unknown storage %s\n", options.storage.c_str());
+		return EXIT_FAILURE;
+	}
+	const NumericalStorage storage = NumericalStorage(storageName - storageNames.cbegin());
+	const std::vector<std::string> transformNames = { "none", "log", "sqrt", "arcsinh" };
+	const auto transformName = std::find(transformNames.cbegin(), transformNames.cend(), options.transform);
+	const std::vector<std::string> normalizationNames = { "none", "zscore", "minmax" };
+	const auto normalizationName = std::find(normalizationNames.cbegin(), normalizationNames.cend(), options.normalization);
+	if (transformName == transformNames.cend() || normalizationName == normalizationNames.cend())
+	{
+		std::fprintf(stderr, "unknown transform %s or normalization %s\n", options.transform.c_str(), options.normalization.c_str());
+		return EXIT_FAILURE;
+	}
+	const Normalization normalization = Normalization(normalizationName - normalizationNames.cbegin());
+	std::printf("%s: %.1f MB, %d threads, %s numbers, %s transform, %s normalization\n", filename.c_str(), megabytes, omp_get_max_threads(), options.storage.c_str(), options.transform.c_str(), options.normalization.c_str());
+
+	CSVReader reader(qfilename, options.separator, options.column_header, options.row_header);
+	reader.set_transform(CSVReader::TRANSFORM::Type(transformName - transformNames.cbegin()));
+	const double read_time = time_phase(options.repeat, [&reader]() { reader.read(); });
+	const std::size_t rows = reader.rows();
+	std::printf("%zu rows, %zu columns\n\n", rows, reader.columns());
+	if (rows == 0)
+		return EXIT_FAILURE;
+	report("read", read_time, megabytes, rows);
+
+	// tokenizing only, every item is touched so it cannot be optimized away
+	Labels column_header;
+	Labels row_header;
+	std::vector<std::size_t> item_bytes(omp_get_max_threads(), 0);
+	report("process", time_phase(options.repeat, [&]()
+	{
+		reader.for_each_cell("Tokenizing", false, column_header, row_header, {}, {}, [&item_bytes](std::size_t, std::size_t, std::string_view item) { item_bytes[omp_get_thread_num()] += item.size(); });
+	}), megabytes, rows);
+
+	report("get_data", time_phase(options.repeat, [&]()
+	{
+		TypedColumns columns;
+		load_numerical_columns(reader, false, {}, {}, storage, SparseMode::Dense, columns);
+	}), megabytes, rows);
+
+	report("get_data (T)", time_phase(options.repeat, [&]()
+	{
+		TypedColumns columns;
+		load_numerical_columns(reader, true, {}, {}, storage, SparseMode::Dense, columns);
+	}), megabytes, rows);
+
+	std::size_t storedBytes = 0;
+	report("storage", time_phase(options.repeat, [&]()
+	{
+		TypedColumns columns;
+		load_numerical_columns(reader, false, {}, {}, storage, SparseMode::Dense, columns);
+		finish_numerical_data(columns, storage, normalization);
+		storedBytes = std::visit([](const auto& numerical_data) { return numerical_data.size() * sizeof(numerical_data[0]); }, columns.numerical_data);
+	}), megabytes, rows);
+
+	std::size_t nrOfValues = 0;
+	report("sparse", time_phase(options.repeat, [&]()
+	{
+		TypedColumns columns;
+		load_numerical_columns(reader, false, {}, {}, storage, SparseMode::Sparse, columns);
+		nrOfValues = columns.sparse_data.values.size();
+	}), megabytes, rows);
+
+	report("sparse (T)", time_phase(options.repeat, [&]()
+	{
+		TypedColumns columns;
+		load_numerical_columns(reader, true, {}, {}, storage, SparseMode::Sparse, columns);
+	}), megabytes, rows);
+
+	report("sparse+densify", time_phase(options.repeat, [&]()
+	{
+		TypedColumns columns;
+		load_numerical_columns(reader, false, {}, {}, storage, SparseMode::Sparse, columns);
+		densify(columns);
+	}), megabytes, rows);
+
+	TypedColumns typed_columns;
+	report("type detection", time_phase(options.repeat, [&]()
+	{
+		load_typed_columns(reader, false, {}, {}, true, false, storage, typed_columns);
+	}), megabytes, rows);
+
+	report("sampled types", time_phase(options.repeat, [&]()
+	{
+		load_typed_columns(reader, false, {}, {}, true, true, storage, typed_columns);
+	}), megabytes, rows);
+
+	std::size_t nrOfClusters = 0;
+	report("clustering", time_phase(options.repeat, [&]()
+	{
+		nrOfClusters = 0;
+		for (std::size_t column = 0; column < typed_columns.types.size(); ++column)
+		{
+			if (typed_columns.types[column] == ColumnType::Categorical || typed_columns.types[column] == ColumnType::Color)
+			{
+				nrOfClusters += cluster_indices(typed_columns.categorical[column]).size();
+				partition_signature(typed_columns.categorical[column]);
+			}
+		}
+	}), megabytes, rows);
+	std::printf("\n%zu numerical columns, %zu clusters, %zu non-zero values, %.1f MB stored\n", typed_columns.numerical_columns.size(), nrOfClusters, nrOfValues, double(storedBytes) / (1024.0 * 1024.0));
+
+	if (options.file.empty() && !options.keep)
+		std::remove(filename.c_str());
+	return EXIT_SUCCESS;
+}
@@ -1,23 +1,33 @@
 #include "CsvLoader.h"
 
+#include "DimensionPickerDialog.h"
+#include "csvcache.h"
+#include "csvcolumns.h"
 #include "csvreader.h"
 
 #include <Dataset.h>
+#include <ForegroundTask.h>
 
 #include <ClusterData/ClusterData.h>
-#include <PointData/DimensionsPickerAction.h>
 #include <PointData/PointData.h>
 #include <util/Icon.h>
 #include <util/StyledIcon.h>
 
 #include <QDialogButtonBox>
 #include <QMainWindow>
+#include <QtConcurrent>
 #include <QtCore>
 
+#include <omp.h>
+
 #include <algorithm>
-#include <map>
-#include <stdlib.h>
+#include <chrono>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <variant>
 #include <vector>
 
 Q_PLUGIN_METADATA(IID "nl.lumc.ExtCsvLoader")
@@ -31,18 +41,27 @@ using namespace mv::gui;
 
 namespace
 {
-    std::vector<QString> toQStringVector(const std::vector<std::string>& v)
+    QString toQString(std::string_view label)
     {
-        std::vector<QString> result(v.size());
-        for (std::size_t i = 0; i < v.size(); ++i)
-            result[i] = v[i].c_str();
+        return QString::fromUtf8(label.data(), qsizetype(label.size()));
+    }
+
+    // all labels are converted in parallel, straight into the storage of the list
+    QVariantList toQVariantList(const ExtCsvLoader::Labels& labels)
+    {
+        QVariantList result(labels.size());
+        QVariant* items = result.data();
+#pragma omp parallel for schedule(static)
+        for (std::ptrdiff_t i = 0; i < std::ptrdiff_t(labels.size()); ++i)
+            items[i] = toQString(labels[i]);
         return result;
     }
-    QVariantList toQVariantList(const std::vector<std::string>& v)
+
+    QVariantList toQVariantList(const std::vector<float>& v)
     {
         QVariantList result(v.size());
         for (std::size_t i = 0; i < v.size(); ++i)
-            result[i] = QString::fromStdString(v[i]);
+            result[i] = v[i];
         return result;
     }
     std::vector<std::string> toStringVector(const QVariantList& l)
@@ -82,15 +101,6 @@ namespace
             colors.clear();
     }
 
-    bool is_number(const std::string& s)
-    {
-        if (s.empty())
-            return true;
-        char* end = nullptr;
-        strtod(s.c_str(), &end);
-        return *end == '\0';
-    }
-
 }
 
 
@@ -100,8 +110,15 @@ CsvLoader::CsvLoader(const PluginFactory* factory) : LoaderPlugin(factory)
 , _rowHeaderCheckBox(nullptr)
 , _transposeCheckBox(nullptr)
 , _mixedDataHierarchyCheckbox(nullptr)
+, _sampleTypesCheckBox(nullptr)
 , _sourceTypeComboBox(nullptr)
 , _storageTypeComboBox(nullptr)
+, _missingValueComboBox(nullptr)
+, _sparseComboBox(nullptr)
+, _transformComboBox(nullptr)
+, _normalizationComboBox(nullptr)
+, _cacheCheckBox(nullptr)
+, _concatenateCheckBox(nullptr)
 , _datasetPickerAction(this, "Parent Dataset")
 {
 
@@ -114,24 +131,38 @@ CsvLoader::~CsvLoader(void)
 // Alphabetic list of keys used to access settings from QSettings.
 namespace Keys
 {
+    const QString cacheValueKey("cache");
     const QString columnHeaderValueKey("columnHeader");
+    const QString concatenateValueKey("concatenate");
     const QString fileNameKey("fileName");
     const QString hierarchyValueKey("hierarchy");
+    const QString missingValueKey("missingValue");
+    const QString normalizationValueKey("normalizationValue");
     const QString rowHeaderValueKey("rowHeader");
+    const QString sampleTypesValueKey("sampleTypes");
     const QString selectedNameFilterKey("selectedNameFilter");
     const QString separatorValueKey("separatorValue");
     const QString sourceValueKey("sourceValue");
+    const QString sparseValueKey("sparseValue");
     const QString storageValueKey("storageValue");
+    const QString transformValueKey("transformValue");
     const QString transposeValueKey("transposeValue");
 }
 
+// File dialog name filters, gzip and zstd compressed files are decompressed while loading.
+namespace NameFilters
+{
+    const QString csv("CSV (*.csv *.txt *.csv.gz *.txt.gz *.csv.zst *.txt.zst)");
+    const QString tsv("TSV (*.tsv *.tsv.gz *.tsv.zst)");
+}
+
 void CsvLoader::init()
 {
     QStringList fileTypeOptions;
-    fileTypeOptions.append("CSV (*.csv *.txt)");
-    fileTypeOptions.append("TSV (*.tsv)");
+    fileTypeOptions.append(NameFilters::csv);
+    fileTypeOptions.append(NameFilters::tsv);
     _fileDialog.setOption(QFileDialog::DontUseNativeDialog);
-    _fileDialog.setFileMode(QFileDialog::ExistingFile);
+    _fileDialog.setFileMode(QFileDialog::ExistingFiles);
     _fileDialog.setOption(QFileDialog::DontUseNativeDialog, true);
     _fileDialog.setOption(QFileDialog::DontResolveSymlinks, true);
     _fileDialog.setOption(QFileDialog::DontUseCustomDirectoryIcons, true);
@@ -203,15 +234,107 @@ void CsvLoader::init()
     fileDialogLayout->addWidget(mixedDataHierarchyLabel, rowCount, 0);
     fileDialogLayout->addWidget(_mixedDataHierarchyCheckbox, rowCount++, 1);
 
+    QLabel* sampleTypesLabel = new QLabel("Sample Types");
+    _sampleTypesCheckBox = new QCheckBox();
+    _sampleTypesCheckBox->setToolTip("Detect the type of every dimension on an evenly spread sample of the rows and verify it while parsing, "
+                                     "all rows are only inspected when a sampled type turns out to be wrong");
+    {
+        const auto sampleTypesValue = getSetting(Keys::sampleTypesValueKey, true).toBool();
+        _sampleTypesCheckBox->setChecked(sampleTypesValue);
+    }
+    QObject::connect(_sourceTypeComboBox, &QComboBox::currentIndexChanged, [sampleTypesLabel, this](int index)
+        {
+            sampleTypesLabel->setVisible(index == 0);
+            this->_sampleTypesCheckBox->setVisible(index == 0);
+        });
+
+    fileDialogLayout->addWidget(sampleTypesLabel, rowCount, 0);
+    fileDialogLayout->addWidget(_sampleTypesCheckBox, rowCount++, 1);
+
     QLabel* storageTypeLabel = new QLabel("Numerical Storage");
     _storageTypeComboBox = new QComboBox;
-    _storageTypeComboBox->addItem("Float (32-bits)", 1);
-    _storageTypeComboBox->addItem("BFloat16 (16-bits)", 2);
+    _storageTypeComboBox->addItem("Float (32-bits)", int(ExtCsvLoader::NumericalStorage::Float));
+    _storageTypeComboBox->addItem("BFloat16 (16-bits)", int(ExtCsvLoader::NumericalStorage::BFloat16));
+    _storageTypeComboBox->addItem("Int8 (8-bits)", int(ExtCsvLoader::NumericalStorage::Int8));
+    _storageTypeComboBox->addItem("UInt8 (8-bits)", int(ExtCsvLoader::NumericalStorage::UInt8));
+    _storageTypeComboBox->addItem("Int16 (16-bits)", int(ExtCsvLoader::NumericalStorage::Int16));
+    _storageTypeComboBox->addItem("UInt16 (16-bits)", int(ExtCsvLoader::NumericalStorage::UInt16));
+    _storageTypeComboBox->addItem("Int32 (32-bits)", int(ExtCsvLoader::NumericalStorage::Int32));
+    _storageTypeComboBox->addItem("Scaled UInt8 (8-bits)", int(ExtCsvLoader::NumericalStorage::ScaledUInt8));
+    _storageTypeComboBox->addItem("Scaled UInt16 (16-bits)", int(ExtCsvLoader::NumericalStorage::ScaledUInt16));
+    _storageTypeComboBox->addItem("Integral (auto-detect)", int(ExtCsvLoader::NumericalStorage::Integral));
+    _storageTypeComboBox->setToolTip("Integer types round other numbers and saturate at their range. Scaled types map the range of every dimension onto the type. "
+                                     "Integral picks the smallest integer type that holds all values, or float when they are not all integers");
     _storageTypeComboBox->setCurrentIndex(getSetting(Keys::storageValueKey, 1).toInt());
 
     fileDialogLayout->addWidget(storageTypeLabel, rowCount, 0);
     fileDialogLayout->addWidget(_storageTypeComboBox, rowCount++, 1);
 
+    QLabel* missingValueLabel = new QLabel("Missing Values");
+    _missingValueComboBox = new QComboBox;
+    _missingValueComboBox->addItem("Zero", 0);
+    _missingValueComboBox->addItem("NaN", 1);
+    _missingValueComboBox->setToolTip("Value used for empty cells and cells that are not a number in numerical dimensions. With Zero, a cell that starts with a number (e.g. 1.5x) is loaded as that number");
+    _missingValueComboBox->setCurrentIndex(getSetting(Keys::missingValueKey, 0).toInt());
+
+    fileDialogLayout->addWidget(missingValueLabel, rowCount, 0);
+    fileDialogLayout->addWidget(_missingValueComboBox, rowCount++, 1);
+
+    QLabel* transformLabel = new QLabel("Transform");
+    _transformComboBox = new QComboBox;
+    _transformComboBox->addItem("None", int(ExtCsvLoader::CSVReader::TRANSFORM::NONE));
+    _transformComboBox->addItem("Log2 (x + 1)", int(ExtCsvLoader::CSVReader::TRANSFORM::LOG));
+    _transformComboBox->addItem("Square root", int(ExtCsvLoader::CSVReader::TRANSFORM::SQRT));
+    _transformComboBox->addItem("Arcsinh (x / 5)", int(ExtCsvLoader::CSVReader::TRANSFORM::ARCSIN5));
+    _transformComboBox->setToolTip("Transform every number of the numerical dimensions while it is parsed, before it is converted to the numerical storage");
+    _transformComboBox->setCurrentIndex(getSetting(Keys::transformValueKey, 0).toInt());
+
+    fileDialogLayout->addWidget(transformLabel, rowCount, 0);
+    fileDialogLayout->addWidget(_transformComboBox, rowCount++, 1);
+
+    QLabel* normalizationLabel = new QLabel("Normalization");
+    _normalizationComboBox = new QComboBox;
+    _normalizationComboBox->addItem("None", int(ExtCsvLoader::Normalization::None));
+    _normalizationComboBox->addItem("Z-score", int(ExtCsvLoader::Normalization::ZScore));
+    _normalizationComboBox->addItem("Min-max", int(ExtCsvLoader::Normalization::MinMax));
+    _normalizationComboBox->setToolTip("Normalize every numerical dimension after the transform: Z-score to mean 0 and standard deviation 1, Min-max to the range [0, 1]. "
+                                       "Normalized data is not sparse, use a float storage to keep the fractions");
+    _normalizationComboBox->setCurrentIndex(getSetting(Keys::normalizationValueKey, 0).toInt());
+
+    fileDialogLayout->addWidget(normalizationLabel, rowCount, 0);
+    fileDialogLayout->addWidget(_normalizationComboBox, rowCount++, 1);
+
+    QLabel* sparseLabel = new QLabel("Sparse Data");
+    _sparseComboBox = new QComboBox;
+    _sparseComboBox->addItem("Off", int(ExtCsvLoader::SparseMode::Dense));
+    _sparseComboBox->addItem("Automatic", int(ExtCsvLoader::SparseMode::Auto));
+    _sparseComboBox->addItem("On", int(ExtCsvLoader::SparseMode::Sparse));
+    _sparseComboBox->setToolTip("With a numerical source, keep only the non-zero values while the file is parsed and cached, e.g. for count matrices. Automatic does so when the first rows are mostly zeros");
+    _sparseComboBox->setCurrentIndex(getSetting(Keys::sparseValueKey, 1).toInt());
+
+    fileDialogLayout->addWidget(sparseLabel, rowCount, 0);
+    fileDialogLayout->addWidget(_sparseComboBox, rowCount++, 1);
+
+    QLabel* cacheLabel = new QLabel("Cache");
+    _cacheCheckBox = new QCheckBox();
+    _cacheCheckBox->setToolTip("Keep a binary copy of the loaded data next to the file, so loading it again with the same options skips parsing");
+    {
+        const auto cacheValue = getSetting(Keys::cacheValueKey, false).toBool();
+        _cacheCheckBox->setChecked(cacheValue);
+    }
+    fileDialogLayout->addWidget(cacheLabel, rowCount, 0);
+    fileDialogLayout->addWidget(_cacheCheckBox, rowCount++, 1);
+
+    QLabel* concatenateLabel = new QLabel("Concatenate");
+    _concatenateCheckBox = new QCheckBox();
+    _concatenateCheckBox->setToolTip("When several files are selected, append the rows of all files with the same columns to one dataset");
+    {
+        const auto concatenateValue = getSetting(Keys::concatenateValueKey, false).toBool();
+        _concatenateCheckBox->setChecked(concatenateValue);
+    }
+    fileDialogLayout->addWidget(concatenateLabel, rowCount, 0);
+    fileDialogLayout->addWidget(_concatenateCheckBox, rowCount++, 1);
+
     // Get unique identifier and gui names from all point data sets in the core
     auto dataSets = mv::data().getAllDatasets(std::vector<mv::DataType> {PointType});
 
@@ -234,7 +357,7 @@ void CsvLoader::init()
 
     const auto onFilterSelected = [separatorLabel, this](const QString& nameFilter)
     {
-        const bool isTSVSelected{ nameFilter == "TSV (*.tsv)" };
+        const bool isTSVSelected{ nameFilter == NameFilters::tsv };
         this->_separatorLineEdit->setVisible(!isTSVSelected);
         separatorLabel->setVisible(!isTSVSelected);
     };
@@ -244,517 +367,705 @@ void CsvLoader::init()
 }
 
 
-void CsvLoader::loadData()
+namespace
 {
-    if (_fileDialog.exec())
+    // the dimensions are selected from the header and the first rows of the file
+    constexpr std::size_t SampleRows = 100;
+
+    QString columnTypeName(const ExtCsvLoader::ColumnType type)
     {
-        QStringList fileNames = _fileDialog.selectedFiles();
+        switch (type)
+        {
+        case ExtCsvLoader::ColumnType::Numerical:   return "numerical";
+        case ExtCsvLoader::ColumnType::Categorical: return "categorical";
+        case ExtCsvLoader::ColumnType::Color:       return "color";
+        default:                                    return "unknown";
+        }
+    }
 
-        if (fileNames.empty())
+    // everything a load needs after loadData has returned, shared by the stages of the load
+    struct LoadJob
+    {
+        LoadJob(const QString& fileName, const char separator, const bool columnHeader, const bool rowHeader)
+            : fileName(fileName)
+            , datasetName(QFileInfo(fileName).baseName())
+            , reader(fileName, separator, columnHeader, rowHeader)
+            , cache(ExtCsvLoader::cache_file_name(fileName))
         {
-            return;
         }
-        const QString firstFileName = fileNames.constFirst();
 
-        bool result = true;
-        QString selectedNameFilter = _fileDialog.selectedNameFilter();
+        QString fileName;
+        QString datasetName;
+        ExtCsvLoader::CSVReader reader;
+        int sourceType = 0;
+        bool transposed = false;
+        bool mixedHierarchy = false;
+        bool sampleTypes = false;
+        ExtCsvLoader::NumericalStorage numericalStorage = ExtCsvLoader::NumericalStorage::Float;
+        ExtCsvLoader::SparseMode sparseMode = ExtCsvLoader::SparseMode::Dense;
+        ExtCsvLoader::Normalization normalization = ExtCsvLoader::Normalization::None;
+
+        bool useCache = false;
+        std::string sourceKey;
+        ExtCsvLoader::CsvCache cache;
+        bool cacheFound = false;
+
+        Dataset<DatasetImpl> parentDataset;
+        std::vector<std::string> parent_labels;
+        std::vector<std::string> dimension_labels;
+        std::vector<ExtCsvLoader::ColumnType> columnTypeHints;    // detected on the sample, shown in the dimension picker
 
-        const char sep = _separatorLineEdit->text().toStdString()[0];
-        setSetting(Keys::separatorValueKey, sep);
-        setSetting(Keys::columnHeaderValueKey, _columnHeaderCheckBox->isChecked());
-        setSetting(Keys::rowHeaderValueKey, _rowHeaderCheckBox->isChecked());
+        ExtCsvLoader::TypedColumns typedColumns;
+        bool loaded = false;
 
-        setSetting(Keys::transposeValueKey, _transposeCheckBox->isChecked());
-        setSetting(Keys::sourceValueKey, _sourceTypeComboBox->currentIndex());
-        setSetting(Keys::storageValueKey, _storageTypeComboBox->currentIndex());
-        setSetting(Keys::fileNameKey, firstFileName);
-        setSetting(Keys::selectedNameFilterKey, selectedNameFilter);
+        // a cluster dataset per entry of clusterColumns, named after that column, with the clusters at the same index
+        std::vector<std::ptrdiff_t> clusterColumns;
+        std::vector<QVector<Cluster>> clusters;
+
+        // created on the gui thread, the views are notified once all of them are complete
+        Dataset<Points> pointsDataset;
+        std::vector<Dataset<Clusters>> clusterDatasets;
 
-        char selected_separator = _separatorLineEdit->text()[0].toLatin1();
-        if (selectedNameFilter == "TSV (*.tsv)")
+        ForegroundTask* task = nullptr;
+    };
+
+    // one pool for all loads, so one file can be read while another one is parsed. every load parses with OpenMP itself.
+    // see setLoadThreads for how the two threads share the cores
+    QThreadPool* loadPool()
+    {
+        struct LoadPool : QThreadPool
         {
-            selected_separator = '\t';
+            LoadPool()
+            {
+                setMaxThreadCount(2);
+            }
+        };
+        static LoadPool pool;
+        return &pool;
+    }
+
+    // worker thread: the OpenMP threads of the calling thread of the load pool. When the files of a batch are loaded at
+    // the same time by both threads of the pool, each of them gets half the cores, so their teams do not oversubscribe
+    // the cores and the buffers per OpenMP thread are not allocated twice over. Otherwise a load runs alone and gets all.
+    void setLoadThreads(const bool shared)
+    {
+        // taken before any thread of the pool changes its own number of threads
+        static const int nrOfThreads = omp_get_max_threads();
+        omp_set_num_threads(shared ? std::max(1, nrOfThreads / 2) : nrOfThreads);
+    }
+
+    // worker thread: opens the cache or reads the csv file. To select the dimensions from only the headers and
+    // a sample of the rows are read, the whole file is then only read once the dimensions are selected.
+    void readSource(LoadJob& job, const bool sample)
+    {
+        job.cacheFound = job.useCache && job.cache.open(job.sourceKey);
+        if (job.cacheFound)
+            return;
+
+        if (job.transposed || !sample)
+        {
+            job.reader.read();
+        }
+        else
+        {
+            job.reader.read(SampleRows);
+            if (job.sourceType == 0)
+                job.columnTypeHints = ExtCsvLoader::detect_column_types(job.reader, true);
         }
-        ExtCsvLoader::CSVReader reader(firstFileName, selected_separator, _columnHeaderCheckBox->isChecked(), _rowHeaderCheckBox->isChecked());
-        reader.read();
+    }
 
-        const int sourceType    = _sourceTypeComboBox->currentData().toInt();
-        const bool transposed   = _transposeCheckBox->isChecked();
+    // gui thread: lets the user select the dimensions to load
+    void selectDimensions(LoadJob& job)
+    {
+        if (job.reader.cancelled() || job.transposed)
+            return;
 
-        auto parentDataset      = _datasetPickerAction.getCurrentDataset();
+        const auto& loadedColumnHeader = job.cacheFound ? job.cache.source_column_header() : job.reader.GetColumnHeader();
+        if (loadedColumnHeader.empty())
+            return;
 
-        std::vector<std::string> parent_labels;
+        std::vector<QString> typeHints;
+        if (job.columnTypeHints.size() == loadedColumnHeader.size())
+        {
+            typeHints.resize(loadedColumnHeader.size());
+            for (std::size_t i = 0; i < typeHints.size(); ++i)
+                typeHints[i] = columnTypeName(job.columnTypeHints[i]);
+        }
 
-        if (parentDataset.isValid() && parentDataset->hasProperty("Sample Names"))
+        DimensionPickerDialog dialog(loadedColumnHeader, typeHints, Application::getMainWindow());
+        if (dialog.exec() == 0)
         {
-            QVariantList parentSampleNameList;
-            parentSampleNameList = parentDataset->getProperty("Sample Names").toList();
-            parent_labels = toStringVector(parentSampleNameList);
+            job.reader.cancel();
+            return;
         }
 
-        std::vector<std::string> dimension_labels;
-        if(!_transposeCheckBox->isChecked())
+        // no dimension labels selects all dimensions
+        const std::vector<std::size_t> selectedDimensions = dialog.selectedDimensions();
+        if (selectedDimensions.size() < loadedColumnHeader.size())
         {
-            auto loadedColumnHeader = reader.GetColumnHeader();
-            std::vector<QString> dimensionNames(loadedColumnHeader.size());
-            for (std::size_t i = 0; i < dimensionNames.size(); ++i)
+            job.dimension_labels.reserve(selectedDimensions.size());
+            for (const std::size_t dim : selectedDimensions)
             {
-                dimensionNames[i] = loadedColumnHeader[i].c_str();
+                job.dimension_labels.emplace_back(loadedColumnHeader[dim]);
             }
-            Dataset<Points> tempDataset = mv::data().createDataset("Points", "temp");
-            tempDataset->getDataHierarchyItem().setVisible(false);
-            tempDataset->setData(std::vector<int8_t>(dimensionNames.size()), dimensionNames.size());
-            tempDataset->setDimensionNames(dimensionNames);
-
-            QDialog dialog(Application::getMainWindow());
-            QGridLayout* layout = new QGridLayout;
-
-            DimensionsPickerAction& dimensionPickerAction = tempDataset->getDimensionsPickerAction();;
-            layout->addWidget(new QLabel("Select Dimensions:"));
-            layout->addWidget(dimensionPickerAction.createWidget(Application::getMainWindow()));
-            auto* buttonBox = new QDialogButtonBox(QDialogButtonBox::Ok);
-            buttonBox->connect(buttonBox, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
-            layout->addWidget(buttonBox, 3, 0, 1, 2);
-            dialog.setLayout(layout);
-            auto result = dialog.exec();
-            if (result != 0)
+        }
+    }
+
+    // worker thread: matches the color columns with the categorical columns and builds the clusters of every cluster dataset
+    void buildClusters(LoadJob& job)
+    {
+        using ExtCsvLoader::ColumnType;
+        ExtCsvLoader::TypedColumns& typedColumns = job.typedColumns;
+        const std::vector<ColumnType>& detectedDataType = typedColumns.types;
+        const std::ptrdiff_t items = detectedDataType.size();
+
+        // the clusters of every categorical and color column, column j gets its colors from column hasColor[j]
+        // and clusterColor[j] maps every cluster of j to its value in that color column
+        const auto phaseStart = std::chrono::steady_clock::now();
+        std::vector<ExtCsvLoader::ClusterIndices> cluster_info(items);
+        std::vector<std::ptrdiff_t> hasColor(items, -1);
+        std::vector<std::vector<std::uint32_t>> clusterColor(items);
+
+        std::vector<std::ptrdiff_t> nrOfColors(items, 0);
+        std::vector<std::uint64_t> signature(items, 0);
+#pragma omp parallel for schedule(dynamic,1)
+        for (std::ptrdiff_t i = 0; i < items; ++i)
+        {
+            if ((detectedDataType[i] == ColumnType::Categorical) || (detectedDataType[i] == ColumnType::Color))
             {
-                auto selectedDimensions = dimensionPickerAction.getSelectedDimensions();
-                dimension_labels.reserve(selectedDimensions.size());
-                for(auto dim : selectedDimensions)
-                {
-                    dimension_labels.push_back(loadedColumnHeader[dim]);
-                }
+                const ExtCsvLoader::CategoricalColumn& column = typedColumns.categorical[i];
+                cluster_info[i] = ExtCsvLoader::cluster_indices(column);
+                signature[i] = ExtCsvLoader::partition_signature(column);
             }
-            mv::data().removeDataset(tempDataset);
+            if (detectedDataType[i] == ColumnType::Color)
+                nrOfColors[i] = cluster_info[i].size();
         }
-        
-        std::vector<std::string> column_header;
-        std::vector<std::string> row_header;
-        if (sourceType == 1)
-        {
-            int storageType = _storageTypeComboBox->currentData().toInt();
 
-            Dataset<Points> pointsDataset;
+        // a color column belongs to a categorical column when both group the rows in exactly the same way,
+        // so only categorical columns with the same partition signature are candidates
+        std::unordered_map<std::uint64_t, std::vector<std::ptrdiff_t>> columnsWithSignature;
+        for (std::ptrdiff_t j = 0; j < items; ++j)
+        {
+            if (detectedDataType[j] == ColumnType::Categorical)
+                columnsWithSignature[signature[j]].push_back(j);
+        }
 
-            if (storageType == 1)
+        std::vector<std::ptrdiff_t> matchedColumn(items, -1);
+        std::vector<std::vector<std::uint32_t>> matchedColors(items);
+#pragma omp parallel for schedule(dynamic,1)
+        for (std::ptrdiff_t i = 0; i < items; ++i)
+        {
+            if (nrOfColors[i] > 0)
             {
-                float* data_ptr = reader.get_data<float>(transposed, column_header, row_header, parent_labels, dimension_labels);
-                if (data_ptr)
-                {
-                    pointsDataset = ::createPointsDataset(QFileInfo(firstFileName).baseName(), parentDataset);;
-                    pointsDataset->setDataElementType<float>();
-                    pointsDataset->setData(data_ptr, row_header.size(), column_header.size());
+                const auto candidates = columnsWithSignature.find(signature[i]);
+                if (candidates == columnsWithSignature.cend())
+                    continue;
 
-                    events().notifyDatasetDataChanged(pointsDataset);
-                    events().notifyDatasetDataDimensionsChanged(pointsDataset);
-
-                    delete[] data_ptr;
-                }
-                else
+                // we look for the items closest to the color, the one before it first
+                std::vector<std::ptrdiff_t> closest = candidates->second;
+                std::sort(closest.begin(), closest.end(), [i](std::ptrdiff_t a, std::ptrdiff_t b)
                 {
-                    return;
+                    return std::make_pair(std::abs(a - i), a > i) < std::make_pair(std::abs(b - i), b > i);
+                });
+                for (const std::ptrdiff_t j : closest)
+                {
+                    // equal signatures can still be a hash collision, so verify the partition itself
+                    if (ExtCsvLoader::same_partition(typedColumns.categorical[j], typedColumns.categorical[i], matchedColors[i]))
+                    {
+                        matchedColumn[i] = j;
+                        break;
+                    }
                 }
+            }
+        }
 
+        for (std::ptrdiff_t i = 0; i < items; ++i)
+        {
+            const std::ptrdiff_t j = matchedColumn[i];
+            if (j >= 0 && hasColor[j] < 0)
+            {
+                hasColor[j] = i; // i is a color for j
+                clusterColor[j] = std::move(matchedColors[i]);
+            }
+        }
 
+        for (auto& column : typedColumns.categorical)
+            std::vector<std::uint32_t>().swap(column.codes);
+
+        // every categorical column gets a dataset, followed by the color columns that are not the colors of one
+        std::vector<std::uint8_t> usedColor(items, 0);
+        job.clusterColumns.clear();
+        for (std::ptrdiff_t i = 0; i < items; ++i)
+        {
+            if (detectedDataType[i] == ColumnType::Categorical)
+            {
+                job.clusterColumns.push_back(i);
+                if (hasColor[i] >= 0)
+                    usedColor[hasColor[i]] = 1;
             }
-            else if (storageType == 2)
+        }
+        for (std::ptrdiff_t i = 0; i < items; ++i)
+        {
+            if (detectedDataType[i] == ColumnType::Color && !usedColor[i])
+                job.clusterColumns.push_back(i);
+        }
+
+        // the clusters of a column are built in parallel into a vector of the final size, so they can be moved into the dataset
+        job.clusters.assign(job.clusterColumns.size(), {});
+        for (std::size_t d = 0; d < job.clusterColumns.size(); ++d)
+        {
+            const std::ptrdiff_t i = job.clusterColumns[d];
+            const std::ptrdiff_t colorIndex = hasColor[i];
+            const std::vector<std::string>& clusterValues = typedColumns.categorical[i].values;
+            std::vector<QColor> generated_colors;
+            if (detectedDataType[i] == ColumnType::Categorical && colorIndex < 0)
+                CreateColorVector(cluster_info[i].size(), generated_colors);
+
+            QVector<Cluster>& columnClusters = job.clusters[d];
+            columnClusters.resize(cluster_info[i].size());
+#pragma omp parallel for schedule(dynamic,64)
+            for (std::ptrdiff_t c = 0; c < std::ptrdiff_t(columnClusters.size()); ++c)
             {
-                biovault::bfloat16_t* data_ptr = reader.get_data< biovault::bfloat16_t>(transposed, column_header, row_header, parent_labels, dimension_labels);
-                if (data_ptr)
-                {
-                    pointsDataset = ::createPointsDataset(QFileInfo(firstFileName).baseName(), parentDataset);;
-                    pointsDataset->setDataElementType<biovault::bfloat16_t>();
-                    pointsDataset->setData(data_ptr, row_header.size(), column_header.size());
+                const auto indices = cluster_info[i][c];
+                Cluster& cluster = columnClusters[c];
+                cluster.getIndices().assign(indices.begin(), indices.end());
+                cluster.setName(clusterValues[c].c_str());
+                if (detectedDataType[i] == ColumnType::Color)
+                    cluster.setColor(QColor(QString(clusterValues[c].c_str())));
+                else if (colorIndex >= 0)
+                    cluster.setColor(QColor(QString(typedColumns.categorical[colorIndex].values[clusterColor[i][c]].c_str())));
+                else
+                    cluster.setColor(generated_colors[c]);
+            }
+            // the clusters hold the indices now
+            cluster_info[i] = ExtCsvLoader::ClusterIndices();
+        }
+        job.reader.stats().cluster_seconds += ExtCsvLoader::seconds_since(phaseStart);
+    }
 
-                    events().notifyDatasetDataChanged(pointsDataset);
-                    events().notifyDatasetDataDimensionsChanged(pointsDataset);
+    // worker thread: loads the selected data from the cache or parses it from the csv file
+    void parseData(LoadJob& job)
+    {
+        if (job.reader.cancelled())
+            return;
 
-                    delete[] data_ptr;
-                }
-                else
-                {
-                    return;
-                }
+        const std::string selectionKey = ExtCsvLoader::selection_key(job.parent_labels, job.dimension_labels);
+        job.loaded = job.cacheFound && job.cache.load(selectionKey, job.typedColumns);
+        job.cache.close();
+        if (!job.loaded)
+        {
+            if (!job.reader.complete())
+                job.reader.read();
+
+            // numbers that are normalized are parsed as float, they only get their storage afterwards
+            const auto parsedStorage = (job.normalization == ExtCsvLoader::Normalization::None) ? job.numericalStorage : ExtCsvLoader::NumericalStorage::Float;
+            job.loaded = (job.sourceType == 1)
+                ? ExtCsvLoader::load_numerical_columns(job.reader, job.transposed, job.parent_labels, job.dimension_labels, parsedStorage, job.sparseMode, job.typedColumns)
+                : ExtCsvLoader::load_typed_columns(job.reader, job.transposed, job.parent_labels, job.dimension_labels, job.sourceType == 0, job.sampleTypes, parsedStorage, job.typedColumns);
+            if (job.loaded && job.useCache)
+                ExtCsvLoader::CsvCache::write(ExtCsvLoader::cache_file_name(job.fileName), job.sourceKey, job.reader.GetColumnHeader(), selectionKey, job.typedColumns);
+        }
+    }
 
-            }
+    // worker thread: appends the rows of all loaded files with the same columns as the first one to that file, with an extra
+    // "File" column that tells where every row comes from. Returns the files to create datasets for, the combined one first.
+    std::vector<std::shared_ptr<LoadJob>> concatenateFiles(const std::vector<std::shared_ptr<LoadJob>>& jobs)
+    {
+        std::vector<std::shared_ptr<LoadJob>> result;
+        std::vector<ExtCsvLoader::TypedColumns> parts;
+        std::vector<std::string> partFiles;
+        for (const auto& job : jobs)
+        {
+            if (!job->loaded || job->reader.cancelled())
+                continue;
 
-            if (pointsDataset.isValid())
+            if (!result.empty() && !ExtCsvLoader::same_columns(job->typedColumns, parts.front()))
             {
-                pointsDataset->setDimensionNames(toQStringVector(column_header));
-                pointsDataset->setProperty("Sample Names", toQVariantList(row_header));
-
-                // Notify others that the clusters have changed
-                events().notifyDatasetDataChanged(pointsDataset);
-                events().notifyDatasetDataDimensionsChanged(pointsDataset);
+                qWarning() << job->fileName << "has other columns than" << result.front()->fileName << ", it is loaded as a separate dataset";
+                result.push_back(job);
+                continue;
             }
+            if (result.empty())
+                result.push_back(job);
+            else
+                job->loaded = false;
+            partFiles.push_back(QFileInfo(job->fileName).fileName().toStdString());
+            parts.push_back(std::move(job->typedColumns));
+        }
+        if (result.empty())
+            return result;
 
+        LoadJob& combined = *result.front();
+        if (parts.size() == 1)
+        {
+            combined.typedColumns = std::move(parts.front());
         }
         else
         {
-            std::string* data_ptr = reader.get_data<std::string>(transposed, column_header, row_header, parent_labels, dimension_labels);
-            if (data_ptr == nullptr)
+            std::vector<std::size_t> partRows(parts.size());
+            for (std::size_t p = 0; p < parts.size(); ++p)
+                partRows[p] = parts[p].row_header.size();
+
+            ExtCsvLoader::concatenate_rows(parts, combined.typedColumns);
+            combined.datasetName = QString("%1 (%2 files)").arg(combined.datasetName).arg(partRows.size());
+
+            // the file names are the values of the file column, in sorted order like the values of any categorical column
+            ExtCsvLoader::TypedColumns& typedColumns = combined.typedColumns;
+            ExtCsvLoader::CategoricalColumn fileColumn;
+            fileColumn.values = partFiles;
+            std::sort(fileColumn.values.begin(), fileColumn.values.end());
+            fileColumn.values.erase(std::unique(fileColumn.values.begin(), fileColumn.values.end()), fileColumn.values.end());
+            fileColumn.codes.reserve(typedColumns.row_header.size());
+            for (std::size_t p = 0; p < partRows.size(); ++p)
             {
-                return;
+                const auto code = std::uint32_t(std::lower_bound(fileColumn.values.cbegin(), fileColumn.values.cend(), partFiles[p]) - fileColumn.values.cbegin());
+                fileColumn.codes.insert(fileColumn.codes.end(), partRows[p], code);
             }
-            qDebug() << "get_data finished, " << column_header.size() << " x " << row_header.size() << " values retrieved";
-            std::ptrdiff_t items = column_header.size();
-            std::size_t size = row_header.size();
-            std::vector<std::string> clusterNames = column_header;
+            typedColumns.column_header.push_back("File");
+            typedColumns.types.push_back(ExtCsvLoader::ColumnType::Categorical);
+            typedColumns.categorical.push_back(std::move(fileColumn));
+        }
 
-            enum { DT_UNKNOWN, DT_NUMERICAL, DT_CATEGORICAL, DT_COLOR };
+        // the data stays sparse (and in the type it is parsed into) up to here, the final data is only built for the dataset
+        for (const auto& job : result)
+        {
+            buildClusters(*job);
+            ExtCsvLoader::finish_numerical_data(job->typedColumns, job->numericalStorage, job->normalization);
+        }
+        return result;
+    }
 
-            std::vector<uint8_t> detectedDataType(items, DT_UNKNOWN);
+    // gui thread: creates the points and cluster datasets and fills them, without notifying anyone yet
+    void createDatasets(LoadJob& job)
+    {
+        if (!job.loaded || job.reader.cancelled())
+            return;
 
-            std::vector<std::map<std::string, std::vector<unsigned int>>> cluster_info(items);
-            std::vector<std::ptrdiff_t> nrOfColors(items, 0);
-            std::vector<std::ptrdiff_t> hasColor(items,-1);
-            std::vector<uint8_t> processed(items, 0);
+        ExtCsvLoader::TypedColumns& typedColumns = job.typedColumns;
+        const ExtCsvLoader::Labels& column_header = typedColumns.column_header;
+        const ExtCsvLoader::Labels& row_header = typedColumns.row_header;
+        const ExtCsvLoader::Labels& clusterNames = column_header;
 
-            if (sourceType == 0) // autodetect
-            {
-#pragma omp parallel for schedule(dynamic,1)
-                for (std::ptrdiff_t i = 0; i < items; ++i)
-                {
-                    bool isNumerical = true;
-                    bool isColor = true;
-                    bool continueLoop = true;
-                    for (std::size_t s = 0; continueLoop && (s < size); ++s)
-                    {
-                        std::string value = data_ptr[(s * items) + i];
-
-                        if (!value.empty())
-                        {
-                            if (isNumerical)
-                                isNumerical &= is_number(value);
-                            if (isColor)
-                                isColor &= QColor::isValidColor(value.c_str());
-                            continueLoop = (isNumerical || isColor);
-                        }
-                    }
-                    if (isNumerical)
-                        detectedDataType[i] = DT_NUMERICAL;
-                    else if (isColor)
-                        detectedDataType[i] = DT_COLOR;
-                    else
-                        detectedDataType[i] = DT_CATEGORICAL;
-                }
-            }
-            else // treat everything as categorical or color
-            {
-#pragma omp parallel for schedule(dynamic,1)
-                for (std::ptrdiff_t i = 0; i < items; ++i)
-                {
-                    bool isColor = true;
-                    for (std::size_t s = 0; isColor && (s < size); ++s)
-                    {
-                        std::string value = data_ptr[(s * items) + i];
+        const std::ptrdiff_t nrOfNumericalItems = typedColumns.numerical_columns.size();
 
-                        if (!value.empty())
-                        {
-                            if (isColor)
-                                isColor &= QColor::isValidColor(value.c_str());
-                        }
-                    }
-                    if (isColor)
-                        detectedDataType[i] = DT_COLOR;
-                    else
-                        detectedDataType[i] = DT_CATEGORICAL;
-                }
-            }
+        if (job.task)
+            job.task->setProgressDescription("Creating datasets");
+        ExtCsvLoader::LoadStats& loadStats = job.reader.stats();
+        auto phaseStart = std::chrono::steady_clock::now();
 
-            const std::ptrdiff_t nrOfNumericalItems = std::count(detectedDataType.cbegin(), detectedDataType.cend(), DT_NUMERICAL);
+        Dataset<Points>& pointsDataset = job.pointsDataset;
+        if (nrOfNumericalItems)
+        {
+            pointsDataset = ::createPointsDataset(job.datasetName, job.parentDataset);
+            std::vector<QString> columnHeader(nrOfNumericalItems);
+            for (std::ptrdiff_t numericalIndex = 0; numericalIndex < nrOfNumericalItems; ++numericalIndex)
+                columnHeader[numericalIndex] = toQString(column_header[typedColumns.numerical_columns[numericalIndex]]);
 
-            Dataset<Points> pointsDataset;
-            if (nrOfNumericalItems)
+            std::visit([&pointsDataset, nrOfNumericalItems](auto& numericalData)
+            {
+                using T = typename std::decay_t<decltype(numericalData)>::value_type;
+                pointsDataset->setDataElementType<T>();
+                pointsDataset->setData(std::move(numericalData), nrOfNumericalItems);
+            }, typedColumns.numerical_data);
+
+            pointsDataset->setDimensionNames(columnHeader);
+            pointsDataset->setProperty("Sample Names", toQVariantList(row_header));
+            if (!typedColumns.quantization_scale.empty())
             {
-                int storageType = _storageTypeComboBox->currentData().toInt();
+                // a stored value v of dimension i stands for offset[i] + scale[i] * v
+                pointsDataset->setProperty("Quantization Offset", toQVariantList(typedColumns.quantization_offset));
+                pointsDataset->setProperty("Quantization Scale", toQVariantList(typedColumns.quantization_scale));
+            }
+        }
+        loadStats.dataset_seconds += ExtCsvLoader::seconds_since(phaseStart);
 
-                pointsDataset = ::createPointsDataset(QFileInfo(firstFileName).baseName(), parentDataset);
+        Dataset<DatasetImpl> parentDatasetOfClusterDataset = job.parentDataset;
+        if (!parentDatasetOfClusterDataset.isValid())
+        {
+            if (job.mixedHierarchy && nrOfNumericalItems)
+                parentDatasetOfClusterDataset = pointsDataset;
+        }
 
-                std::vector<std::string> sourceColumnHeader = column_header;
-                std::vector<QString> columnHeader(nrOfNumericalItems);
+        if (!job.clusterColumns.empty())
+        {
+            phaseStart = std::chrono::steady_clock::now();
+
+            // the clusters are built already, every dataset gets all of them with a single move
+            std::vector<Dataset<Clusters>>& clusterDataset = job.clusterDatasets;
+            clusterDataset.reserve(job.clusterColumns.size());
+            for (const std::ptrdiff_t i : job.clusterColumns)
+                clusterDataset.push_back(mv::data().createDataset("Cluster", toQString(clusterNames[i]), parentDatasetOfClusterDataset));
+
+            for (std::size_t d = 0; d < clusterDataset.size(); ++d)
+                clusterDataset[d]->getClusters() = std::move(job.clusters[d]);
+            job.clusters.clear();
+            loadStats.dataset_seconds += ExtCsvLoader::seconds_since(phaseStart);
+        }
+    }
 
-                if (storageType == 1)
-                {
-                    pointsDataset->setDataElementType<float>();
+    // gui thread: tells the views about the datasets of a load once they are complete, every dataset is notified once
+    // instead of after each change, so a view recomputes only once
+    void publishDatasets(LoadJob& job)
+    {
+        if (job.pointsDataset.isValid())
+        {
+            events().notifyDatasetDataChanged(job.pointsDataset);
+            events().notifyDatasetDataDimensionsChanged(job.pointsDataset);
+        }
+        for (const auto& dataset : job.clusterDatasets)
+            events().notifyDatasetDataChanged(dataset);
+        job.pointsDataset = Dataset<Points>();
+        job.clusterDatasets.clear();
+    }
 
-                    std::vector<float> temp(nrOfNumericalItems * size);
-                    std::ptrdiff_t numericalIndex = 0;
-                    for (std::ptrdiff_t i = 0; i < items; ++i)
-                    {
-                        if ((detectedDataType[i] == DT_NUMERICAL))
-                        {
-#pragma omp parallel for schedule(dynamic,1)
-                            for (std::ptrdiff_t s = 0; s < size; ++s)
-                            {
-                                std::string value = data_ptr[(s * items) + i];
-                                if (value.empty())
-                                    temp[(nrOfNumericalItems * s) + numericalIndex] = 0;
-                                else
-                                    temp[(nrOfNumericalItems * s) + numericalIndex] = std::stof(value);
-                            }
-
-                            columnHeader[numericalIndex] = sourceColumnHeader[i].c_str();
-                            ++numericalIndex;
-                        }
-                    }
-                    pointsDataset->setData(temp.data(), size, nrOfNumericalItems);
+    // gui thread: the last stage of every load, also when it failed or was cancelled
+    void finishLoad(LoadJob& job)
+    {
+        if (!job.task)
+            return;
 
-                    events().notifyDatasetDataChanged(pointsDataset);
-                    events().notifyDatasetDataDimensionsChanged(pointsDataset);
-                }
-                else
-                {
-                    pointsDataset->setDataElementType<biovault::bfloat16_t>();
-                    std::vector<biovault::bfloat16_t> temp(nrOfNumericalItems * size);
-                    std::ptrdiff_t numericalIndex = 0;
+        if (job.reader.cancelled())
+            job.task->setAborted();
+        else
+            job.task->setFinished();
+        job.task->deleteLater();
+        job.task = nullptr;
 
-                    for (std::ptrdiff_t i = 0; i < items; ++i)
-                    {
-                        if ((detectedDataType[i] == DT_NUMERICAL))
-                        {
-#pragma omp parallel for schedule(dynamic,1)
-                            for (std::ptrdiff_t s = 0; s < size; ++s)
-                            {
-                                  std::string value = data_ptr[(s * items) + i];
-                                if (value.empty())
-                                    temp[(nrOfNumericalItems * s) + numericalIndex] = 0;
-                                else
-                                    temp[(nrOfNumericalItems * s) + numericalIndex] = std::stof(value);
-                            }
-
-                            columnHeader[numericalIndex] = sourceColumnHeader[i].c_str();
-
-                            ++numericalIndex;
-                            processed[i] = 1;
-                        }
-                    }
-                    pointsDataset->setData(temp.data(), size, nrOfNumericalItems);
+        if (job.loaded)
+            qDebug() << "Loaded" << job.fileName << ":" << job.reader.stats();
+    }
 
-                    events().notifyDatasetDataChanged(pointsDataset);
-                    events().notifyDatasetDataDimensionsChanged(pointsDataset);
+    void failLoad(LoadJob& job)
+    {
+        qWarning() << "Loading" << job.fileName << "failed";
+        job.reader.cancel();
+        finishLoad(job);
+    }
 
+    // gui thread: starts reading and parsing all files on the load pool, once the dimensions are selected.
+    // With concatenate the task of the first file is the task of the whole batch, it finishes with the combined dataset.
+    void loadFiles(const std::vector<std::shared_ptr<LoadJob>>& jobs, const bool concatenate)
+    {
+        QObject* guiContext = QCoreApplication::instance();
+        QList<QFuture<void>> parsed;
+        const bool shared = (jobs.size() > 1);
+        for (const auto& job : jobs)
+        {
+            const bool first = (job == jobs.front());
+            QFuture<void> future = QtConcurrent::run(loadPool(), [job, first, concatenate, shared]()
+            {
+                setLoadThreads(shared);
+                // the first file is already open, its sample was read to select the dimensions
+                if (!first)
+                    readSource(*job, false);
+                parseData(*job);
+                if (!concatenate && job->loaded && !job->reader.cancelled())
+                {
+                    buildClusters(*job);
+                    ExtCsvLoader::finish_numerical_data(job->typedColumns, job->numericalStorage, job->normalization);
                 }
-                pointsDataset->setDimensionNames(columnHeader);
-                pointsDataset->setProperty("Sample Names", toQVariantList(row_header));
-
-                events().notifyDatasetDataChanged(pointsDataset);
-                events().notifyDatasetDataDimensionsChanged(pointsDataset);
-
-            }
+            });
 
-            Dataset<DatasetImpl> parentDatasetOfClusterDataset = parentDataset;
-            if (!parentDatasetOfClusterDataset.isValid())
+            if (concatenate)
             {
-                if (_mixedDataHierarchyCheckbox->isChecked() && nrOfNumericalItems)
-                    parentDatasetOfClusterDataset = pointsDataset;
+                parsed.append(future.then(guiContext, [job, first]()
+                {
+                    if (!first)
+                        finishLoad(*job);
+                })
+                .onFailed(guiContext, [job]() { failLoad(*job); }));
             }
-            const std::size_t nrOfCategoricalItems = std::count(detectedDataType.cbegin(), detectedDataType.cend(), DT_CATEGORICAL);
-            const std::size_t nrOfColorItems = std::count(detectedDataType.cbegin(), detectedDataType.cend(), DT_COLOR);
-
-            if (nrOfCategoricalItems || nrOfColorItems)
+            else
             {
-#pragma omp parallel for schedule(dynamic,1)
-                for (std::ptrdiff_t i = 0; i < items; ++i)
+                future.then(guiContext, [job]()
                 {
-                    if ((detectedDataType[i] == DT_CATEGORICAL) || (detectedDataType[i] == DT_COLOR))
-                    {
-                        for (std::size_t s = 0; s < size; ++s)
-                        {
-                            std::string value = data_ptr[(s * items) + i];
-                            if (value.empty())
-                                value = "N/A";
-                            cluster_info[i][value].push_back(s);
-                        }
-                    }
-                    for (std::map<std::string, std::vector<unsigned int>>::iterator it = cluster_info[i].begin(); it != cluster_info[i].end(); ++it)
-                        std::sort(it->second.begin(), it->second.end());
-                    if (detectedDataType[i] == DT_COLOR)
-                        nrOfColors[i] = cluster_info[i].size();
-                }
+                    createDatasets(*job);
+                    publishDatasets(*job);
+                    finishLoad(*job);
+                })
+                .onFailed(guiContext, [job]() { failLoad(*job); });
             }
-            delete[] data_ptr;
+        }
+
+        if (!concatenate)
+            return;
 
-            if (nrOfCategoricalItems || nrOfColorItems)
+        const auto batch = jobs.front();
+        QtFuture::whenAll(parsed.begin(), parsed.end())
+            .then(loadPool(), [jobs](const QList<QFuture<void>>&)
             {
-#pragma omp parallel for schedule(dynamic,1)
-                for (std::ptrdiff_t i = 0; i < items; ++i)
-                {
-                    if (nrOfColors[i] > 0)
-                    {
-                        for (std::ptrdiff_t offset = 1; offset < items; ++offset) // we look for the items closest to the color
-                        {
-                            for (std::size_t plus = 0; plus < 2; ++plus)
-                            {
-                                std::ptrdiff_t j = plus ? i + offset : i - offset;
-                                if (j >= 0 && j < items)
-                                {
-                                    if (nrOfColors[j] == 0) // j should not be a color itself
-                                    {
-                                        if (nrOfColors[i] <= cluster_info[j].size()) // the number of colors in i should be less or equal to the number of clusters in j;
-                                        {
-                                            bool success = true;
-                                            // test if all color indices match with cluster indices, look for exact matches
-
-                                            for (auto color_it = cluster_info[i].cbegin(); success && (color_it != cluster_info[i].cend()); ++color_it)
-                                            {
-                                                bool exact_match = false;
-                                                for (auto cluster_it = cluster_info[j].cbegin(); success && (cluster_it != cluster_info[j].cend()); ++cluster_it)
-                                                {
-                                                    exact_match |= (color_it->second == cluster_it->second);
-
-                                                }
-                                                success &= exact_match;
-                                            }
-                                            if (success)
-                                            {
-                                                hasColor[j] = i; // i is a color for j
-                                                offset = items;
-                                                plus = 2;
-                                            }
-
-                                            if (false) // not using inexact matches for now
-                                            {
-                                                // test if all color indices match with cluster indices. it's ok for mutiple clusters to have the same color
-                                                for (auto color_it = cluster_info[i].cbegin(); success && (color_it != cluster_info[i].cend()); ++color_it)
-                                                {
-
-                                                    bool found_match = false;
-                                                    for (auto cluster_it = cluster_info[j].cbegin(); success && (cluster_it != cluster_info[j].cend()); ++cluster_it)
-                                                    {
-                                                        found_match |= std::includes(color_it->second.cbegin(), color_it->second.cend(), cluster_it->second.cbegin(), cluster_it->second.cend());
-                                                    }
-                                                    success &= found_match;
-                                                }
-
-                                                if (success)
-                                                {
-                                                    hasColor[j] = i; // i is a color for j
-                                                    offset = items;
-                                                    plus = 2;
-                                                }
-                                            }
-
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
+                // all files are parsed, the concatenation runs alone
+                setLoadThreads(false);
+                return concatenateFiles(jobs);
+            })
+            .then(guiContext, [batch](const std::vector<std::shared_ptr<LoadJob>>& loaded)
+            {
+                for (const auto& job : loaded)
+                    createDatasets(*job);
+                for (const auto& job : loaded)
+                    publishDatasets(*job);
+                finishLoad(*batch);
+            })
+            .onFailed(guiContext, [batch]() { failLoad(*batch); });
+    }
+}
 
+void CsvLoader::loadData()
+{
+    if (_fileDialog.exec())
+    {
+        QStringList fileNames = _fileDialog.selectedFiles();
 
-                // time to make the clusters, first process the non-colors
+        if (fileNames.empty())
+        {
+            return;
+        }
+        const QString firstFileName = fileNames.constFirst();
 
-                std::vector<Dataset<Clusters>> clusterDataset(items);
+        QString selectedNameFilter = _fileDialog.selectedNameFilter();
 
-                for (std::ptrdiff_t i = 0; i < items; ++i)
-                {
-                    if (detectedDataType[i] == DT_CATEGORICAL)
-                    {
-                        QString name = clusterNames[i].c_str();
-                       
-                        clusterDataset[i] = mv::data().createDataset("Cluster", name, parentDatasetOfClusterDataset);
-                    }
-                }
+        // an empty separator field falls back to the default separator
+        const QString separatorText = _separatorLineEdit->text();
+        const char separator = separatorText.isEmpty() ? ',' : separatorText[0].toLatin1();
+        setSetting(Keys::separatorValueKey, separator);
+        setSetting(Keys::columnHeaderValueKey, _columnHeaderCheckBox->isChecked());
+        setSetting(Keys::rowHeaderValueKey, _rowHeaderCheckBox->isChecked());
 
-#pragma omp parallel for schedule(dynamic,1)
-                for (std::ptrdiff_t i = 0; i < items; ++i)
-                {
-                    if (detectedDataType[i] == DT_CATEGORICAL)
-                    {
-                        std::ptrdiff_t colorIndex = hasColor[i];
-                        std::vector<QColor> generated_colors;
-                        if (colorIndex < 0)
-                        {
-                            CreateColorVector(cluster_info[i].size(), generated_colors);
-                        }
-                        std::size_t index = 0;
-
-                       // std::ptrdiff_t nrOfClustersToAdd = cluster_info[i].size();
-                        //auto currentClusters = clusterDataset[i]->getClusters();
-                       // currentClusters.resize(nrOfClustersToAdd);
-
-                        /*
-						#pragma omp parallel for schedule(dynamic,1)
-                        for(std::ptrdiff_t c=0 ;c< nrOfClustersToAdd; ++c)
-                        {
-                            auto it = cluster_info[i].cbegin();
-                            std::advance(it, c);
-                        */
-                        for (auto it = cluster_info[i].cbegin(); it != cluster_info[i].cend(); ++it, ++index)
-                        {
-                            Cluster cluster;
-                            cluster.setIndices(it->second);
-                            cluster.setName(it->first.c_str());
-                            if (colorIndex >= 0)
-                            {
-                                for (auto color_it = cluster_info[colorIndex].cbegin(); color_it != cluster_info[colorIndex].cend(); ++color_it)
-                                {
-                                    if (std::includes(color_it->second.cbegin(), color_it->second.cend(), it->second.cbegin(), it->second.cend()))
-                                    {
-                                        cluster.setColor(QColor(QString(color_it->first.c_str())));
-                                        break;
-                                    }
-                                }
-                            }
-                            else
-                            {
-                                cluster.setColor(generated_colors[index]);
-                            }
-                            //currentClusters[c] = cluster;
-                            clusterDataset[i]->addCluster(cluster);
-                        }
-                        processed[i] = 1;
-                        
-                        if (colorIndex >= 0)
-                        {
-                            processed[colorIndex] = 1; // color has been processed
-                        }
-                            
-                    }
-                }
+        setSetting(Keys::transposeValueKey, _transposeCheckBox->isChecked());
+        setSetting(Keys::sourceValueKey, _sourceTypeComboBox->currentIndex());
+        setSetting(Keys::sampleTypesValueKey, _sampleTypesCheckBox->isChecked());
+        setSetting(Keys::storageValueKey, _storageTypeComboBox->currentIndex());
+        setSetting(Keys::missingValueKey, _missingValueComboBox->currentIndex());
+        setSetting(Keys::sparseValueKey, _sparseComboBox->currentIndex());
+        setSetting(Keys::transformValueKey, _transformComboBox->currentIndex());
+        setSetting(Keys::normalizationValueKey, _normalizationComboBox->currentIndex());
+        setSetting(Keys::cacheValueKey, _cacheCheckBox->isChecked());
+        setSetting(Keys::concatenateValueKey, _concatenateCheckBox->isChecked());
+        setSetting(Keys::fileNameKey, firstFileName);
+        setSetting(Keys::selectedNameFilterKey, selectedNameFilter);
 
-                for (std::ptrdiff_t i = 0; i < items; ++i)
-                {
-                    if (detectedDataType[i] == DT_COLOR)
-                        if (processed[i] == 0)
-                        {
-                            QString name = clusterNames[i].c_str();
-                            clusterDataset[i] = mv::data().createDataset("Cluster", name, parentDatasetOfClusterDataset);
-                        }
-                }
+        char selected_separator = separator;
+        if (selectedNameFilter == NameFilters::tsv)
+        {
+            selected_separator = '\t';
+        }
+        ExtCsvLoader::NumericPolicy numericPolicy;
+        if (_missingValueComboBox->currentData().toInt() == 1)
+        {
+            numericPolicy.empty = ExtCsvLoader::NumericPolicy::Value::NaN;
+            numericPolicy.invalid = ExtCsvLoader::NumericPolicy::Value::NaN;
+            numericPolicy.number_prefix = false;
+        }
 
-                // process unused colors
-#pragma omp parallel for schedule(dynamic,1)
-                for (std::ptrdiff_t i = 0; i < items; ++i)
-                {
-                    if (detectedDataType[i] == DT_COLOR)
-                        if (processed[i] == 0)
-                        {
-                            for (auto it = cluster_info[i].cbegin(); it != cluster_info[i].cend(); ++it)
-                            {
-                                Cluster cluster;
-                                cluster.setIndices(it->second);
-                                cluster.setName(it->first.c_str());
-                                cluster.setColor(QColor(QString(it->first.c_str())));
-
-                                clusterDataset[i]->addCluster(cluster);
-                            }
-                            processed[i] = 1;
-
-                        }
-                }
+        const int sourceType = _sourceTypeComboBox->currentData().toInt();
+        const bool transposed = _transposeCheckBox->isChecked();
+        const bool useCache = _cacheCheckBox->isChecked();
+        const bool concatenate = _concatenateCheckBox->isChecked() && (fileNames.size() > 1);
 
-                // Notify others that the clusters have changed
-                for (std::ptrdiff_t i = 0; i < items; ++i)
-                    if (clusterDataset[i].isValid())
-                        events().notifyDatasetDataChanged(clusterDataset[i]);
+        // the cache is only used when the file and all options that change the loaded data are the same,
+        // it holds the data before normalization, which is parsed as float
+        const std::string cacheOptions = QString("separator=%1 columnHeader=%2 rowHeader=%3 transpose=%4 source=%5 numericalStorage=%6 missing=%7 sparse=%8 transform=%9 normalized=%10")
+            .arg(int(selected_separator)).arg(_columnHeaderCheckBox->isChecked()).arg(_rowHeaderCheckBox->isChecked()).arg(transposed)
+            .arg(sourceType).arg(_storageTypeComboBox->currentData().toInt()).arg(_missingValueComboBox->currentData().toInt()).arg(_sparseComboBox->currentData().toInt())
+            .arg(_transformComboBox->currentData().toInt()).arg(_normalizationComboBox->currentIndex() != 0).toStdString();
 
-            }
+        // every file becomes a child of the selected parent, its rows are matched with the sample names of the parent
+        const Dataset<DatasetImpl> parentDataset = _datasetPickerAction.getCurrentDataset();
+        std::vector<std::string> parent_labels;
+        if (parentDataset.isValid() && parentDataset->hasProperty("Sample Names"))
+        {
+            QVariantList parentSampleNameList;
+            parentSampleNameList = parentDataset->getProperty("Sample Names").toList();
+            parent_labels = toStringVector(parentSampleNameList);
+        }
 
+        std::vector<std::shared_ptr<LoadJob>> jobs;
+        jobs.reserve(fileNames.size());
+        for (const QString& fileName : fileNames)
+        {
+            auto job = std::make_shared<LoadJob>(fileName, selected_separator, _columnHeaderCheckBox->isChecked(), _rowHeaderCheckBox->isChecked());
+            job->reader.set_numeric_policy(numericPolicy);
+            job->reader.set_transform(ExtCsvLoader::CSVReader::TRANSFORM::Type(_transformComboBox->currentData().toInt()));
+            job->sourceType = sourceType;
+            job->transposed = transposed;
+            job->mixedHierarchy = _mixedDataHierarchyCheckbox->isChecked();
+            job->sampleTypes = _sampleTypesCheckBox->isChecked();
+            job->numericalStorage = ExtCsvLoader::NumericalStorage(_storageTypeComboBox->currentData().toInt());
+            job->sparseMode = ExtCsvLoader::SparseMode(_sparseComboBox->currentData().toInt());
+            job->normalization = ExtCsvLoader::Normalization(_normalizationComboBox->currentData().toInt());
+            job->useCache = useCache;
+            if (useCache)
+                job->sourceKey = ExtCsvLoader::source_key(fileName, cacheOptions);
+            job->parentDataset = parentDataset;
+            job->parent_labels = parent_labels;
+
+            // show the progress of the load in ManiVault, killing the task cancels the load
+            const bool batchTask = concatenate && jobs.empty();
+            ForegroundTask* task = new ForegroundTask(nullptr, batchTask ? QString("Loading %1 files").arg(fileNames.size()) : QString("Loading %1").arg(QFileInfo(fileName).fileName()));
+            job->task = task;
+            task->setMayKill(true);
+            task->setRunning();
+            const std::weak_ptr<LoadJob> weakJob = job;
+            QObject::connect(task, &Task::requestAbort, [weakJob]()
+            {
+                if (const auto job = weakJob.lock())
+                    job->reader.cancel();
+            });
+            job->reader.set_progress_function([task](const char* phase, float fraction)
+            {
+                // the reader reports from a worker thread, the task is updated on the gui thread
+                QMetaObject::invokeMethod(task, [task, description = QString(phase), fraction]()
+                {
+                    task->setProgressDescription(description);
+                    task->setProgress(fraction);
+                }, Qt::QueuedConnection);
+            });
+            jobs.push_back(std::move(job));
+        }
+
+        // the task of a concatenated batch stands for all files
+        if (concatenate)
+        {
+            std::vector<std::weak_ptr<LoadJob>> weakJobs(jobs.cbegin(), jobs.cend());
+            QObject::connect(jobs.front()->task, &Task::requestAbort, [weakJobs]()
+            {
+                for (const auto& weakJob : weakJobs)
+                    if (const auto job = weakJob.lock())
+                        job->reader.cancel();
+            });
         }
+
+        // reading, parsing and building the clusters run on worker threads, so ManiVault stays responsive.
+        // the dimension selection and the creation of the datasets are done on the gui thread.
+        // the dimensions are selected once, on the first file, and loaded from all files.
+        QObject* guiContext = QCoreApplication::instance();
+        const auto first = jobs.front();
+        QtConcurrent::run(loadPool(), [first]()
+            {
+                setLoadThreads(false);
+                readSource(*first, true);
+            })
+            .then(guiContext, [jobs, first, concatenate]()
+            {
+                selectDimensions(*first);
+                if (first->reader.cancelled())
+                {
+                    for (const auto& job : jobs)
+                    {
+                        job->reader.cancel();
+                        finishLoad(*job);
+                    }
+                    return;
+                }
+                for (const auto& job : jobs)
+                    job->dimension_labels = first->dimension_labels;
+                loadFiles(jobs, concatenate);
+            })
+            .onFailed(guiContext, [jobs]()
+            {
+                for (const auto& job : jobs)
+                    failLoad(*job);
+            });
     }
 }
 
@@ -27,8 +27,15 @@ class CsvLoader : public LoaderPlugin
     QCheckBox* _rowHeaderCheckBox;
     QCheckBox* _transposeCheckBox;
     QCheckBox* _mixedDataHierarchyCheckbox;
+    QCheckBox* _sampleTypesCheckBox;
     QComboBox* _sourceTypeComboBox;
     QComboBox* _storageTypeComboBox;
+    QComboBox* _missingValueComboBox;
+    QComboBox* _sparseComboBox;
+    QComboBox* _transformComboBox;
+    QComboBox* _normalizationComboBox;
+    QCheckBox* _cacheCheckBox;
+    QCheckBox* _concatenateCheckBox;
     mv::gui::DatasetPickerAction _datasetPickerAction;
 
 public:
@@ -0,0 +1,256 @@
+#include "DimensionPickerDialog.h"
+
+#include <QDialogButtonBox>
+#include <QGridLayout>
+#include <QHBoxLayout>
+#include <QInputDialog>
+#include <QRegularExpression>
+
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+
+// =============================================================================
+// DimensionListModel
+// =============================================================================
+
+DimensionListModel::DimensionListModel(const ExtCsvLoader::Labels& names, const std::vector<QString>& hints, QObject* parent) : QAbstractListModel(parent)
+, _names(names.size())
+, _hints(hints)
+, _selected(names.size(), 1)
+, _visible(names.size())
+, _nrOfSelected(names.size())
+{
+#pragma omp parallel for
+    for (std::ptrdiff_t i = 0; i < std::ptrdiff_t(names.size()); ++i)
+    {
+        const std::string_view name = names[i];
+        _names[i] = QString::fromUtf8(name.data(), qsizetype(name.size()));
+    }
+    std::iota(_visible.begin(), _visible.end(), std::uint32_t(0));
+}
+
+int DimensionListModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : int(_visible.size());
+}
+
+QVariant DimensionListModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= int(_visible.size()))
+        return QVariant();
+
+    const std::uint32_t dimension = _visible[index.row()];
+    switch (role)
+    {
+    case Qt::DisplayRole:
+        if (dimension < _hints.size() && !_hints[dimension].isEmpty())
+            return QString("%1 (%2)").arg(_names[dimension], _hints[dimension]);
+        return _names[dimension];
+
+    case Qt::CheckStateRole:
+        return _selected[dimension] ? Qt::Checked : Qt::Unchecked;
+
+    default:
+        return QVariant();
+    }
+}
+
+bool DimensionListModel::setData(const QModelIndex& index, const QVariant& value, int role)
+{
+    if (!index.isValid() || role != Qt::CheckStateRole || index.row() >= int(_visible.size()))
+        return false;
+
+    const std::uint8_t selected = (value.toInt() == Qt::Checked) ? 1 : 0;
+    std::uint8_t& current = _selected[_visible[index.row()]];
+    if (current != selected)
+    {
+        _nrOfSelected = _nrOfSelected + selected - current;
+        current = selected;
+        emit dataChanged(index, index, { Qt::CheckStateRole });
+    }
+    return true;
+}
+
+Qt::ItemFlags DimensionListModel::flags(const QModelIndex& index) const
+{
+    if (!index.isValid())
+        return Qt::NoItemFlags;
+    return Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsUserCheckable;
+}
+
+void DimensionListModel::setFilter(const QString& pattern)
+{
+    const auto options = QRegularExpression::CaseInsensitiveOption;
+    const bool showAll = pattern.isEmpty() || !QRegularExpression(pattern, options).isValid();
+
+    // match in parallel, every thread with its own expression, then collect the matches in order
+    std::vector<std::uint8_t> matches(_names.size(), 1);
+    if (!showAll)
+    {
+#pragma omp parallel
+        {
+            const QRegularExpression expression(pattern, options);
+#pragma omp for schedule(dynamic,1024)
+            for (std::ptrdiff_t i = 0; i < std::ptrdiff_t(_names.size()); ++i)
+            {
+                matches[i] = expression.match(_names[i]).hasMatch() ? 1 : 0;
+            }
+        }
+    }
+
+    beginResetModel();
+    _visible.clear();
+    for (std::size_t i = 0; i < matches.size(); ++i)
+    {
+        if (matches[i])
+            _visible.push_back(std::uint32_t(i));
+    }
+    endResetModel();
+}
+
+void DimensionListModel::setVisibleSelected(bool selected)
+{
+    for (const std::uint32_t dimension : _visible)
+    {
+        _nrOfSelected = _nrOfSelected + selected - _selected[dimension];
+        _selected[dimension] = selected ? 1 : 0;
+    }
+    if (!_visible.empty())
+        emit dataChanged(index(0), index(int(_visible.size()) - 1), { Qt::CheckStateRole });
+}
+
+std::size_t DimensionListModel::selectNames(const QStringList& names)
+{
+    std::unordered_map<QString, std::uint32_t> dimensionOfName;
+    dimensionOfName.reserve(_names.size());
+    for (std::size_t i = 0; i < _names.size(); ++i)
+    {
+        dimensionOfName.emplace(_names[i], std::uint32_t(i));
+    }
+
+    std::fill(_selected.begin(), _selected.end(), 0);
+    _nrOfSelected = 0;
+    std::size_t found = 0;
+    for (const QString& name : names)
+    {
+        const auto dimension = dimensionOfName.find(name);
+        if (dimension == dimensionOfName.cend())
+            continue;
+
+        ++found;
+        if (!_selected[dimension->second])
+        {
+            _selected[dimension->second] = 1;
+            ++_nrOfSelected;
+        }
+    }
+    if (!_visible.empty())
+        emit dataChanged(index(0), index(int(_visible.size()) - 1), { Qt::CheckStateRole });
+    return found;
+}
+
+std::size_t DimensionListModel::nrOfSelected() const
+{
+    return _nrOfSelected;
+}
+
+std::size_t DimensionListModel::nrOfDimensions() const
+{
+    return _names.size();
+}
+
+std::vector<std::size_t> DimensionListModel::selectedDimensions() const
+{
+    std::vector<std::size_t> result;
+    result.reserve(_nrOfSelected);
+    for (std::size_t i = 0; i < _selected.size(); ++i)
+    {
+        if (_selected[i])
+            result.push_back(i);
+    }
+    return result;
+}
+
+// =============================================================================
+// DimensionPickerDialog
+// =============================================================================
+
+DimensionPickerDialog::DimensionPickerDialog(const ExtCsvLoader::Labels& names, const std::vector<QString>& hints, QWidget* parent) : QDialog(parent)
+, _model(names, hints)
+, _filterLineEdit(new QLineEdit())
+, _listView(new QListView())
+, _summaryLabel(new QLabel())
+, _okButton(nullptr)
+{
+    setWindowTitle("Select Dimensions");
+
+    _filterLineEdit->setPlaceholderText("Filter (regular expression)");
+    _filterLineEdit->setClearButtonEnabled(true);
+
+    // all rows have the same height, so the view does not have to measure every name
+    _listView->setUniformItemSizes(true);
+    _listView->setModel(&_model);
+
+    auto* selectButton = new QPushButton("Select");
+    selectButton->setToolTip("Select all dimensions that match the filter");
+    auto* deselectButton = new QPushButton("Deselect");
+    deselectButton->setToolTip("Deselect all dimensions that match the filter");
+    auto* listButton = new QPushButton("Select list...");
+    listButton->setToolTip("Select exactly the dimensions in a list of names");
+
+    auto* buttonLayout = new QHBoxLayout();
+    buttonLayout->addWidget(selectButton);
+    buttonLayout->addWidget(deselectButton);
+    buttonLayout->addWidget(listButton);
+
+    auto* buttonBox = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+    _okButton = buttonBox->button(QDialogButtonBox::Ok);
+
+    auto* layout = new QGridLayout();
+    layout->addWidget(_filterLineEdit, 0, 0);
+    layout->addWidget(_listView, 1, 0);
+    layout->addLayout(buttonLayout, 2, 0);
+    layout->addWidget(_summaryLabel, 3, 0);
+    layout->addWidget(buttonBox, 4, 0);
+    setLayout(layout);
+    resize(400, 600);
+
+    connect(_filterLineEdit, &QLineEdit::textChanged, this, [this](const QString& pattern) { _model.setFilter(pattern); updateSummary(); });
+    connect(selectButton, &QPushButton::clicked, this, [this]() { _model.setVisibleSelected(true); updateSummary(); });
+    connect(deselectButton, &QPushButton::clicked, this, [this]() { _model.setVisibleSelected(false); updateSummary(); });
+    connect(listButton, &QPushButton::clicked, this, [this]() { selectFromList(); });
+    connect(&_model, &QAbstractItemModel::dataChanged, this, [this]() { updateSummary(); });
+    connect(buttonBox, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(buttonBox, &QDialogButtonBox::rejected, this, &QDialog::reject);
+
+    updateSummary();
+}
+
+void DimensionPickerDialog::updateSummary()
+{
+    _summaryLabel->setText(QString("%1 of %2 dimensions selected, %3 shown").arg(_model.nrOfSelected()).arg(_model.nrOfDimensions()).arg(_model.rowCount()));
+    _okButton->setEnabled(_model.nrOfSelected() > 0);
+}
+
+void DimensionPickerDialog::selectFromList()
+{
+    bool ok = false;
+    const QString text = QInputDialog::getMultiLineText(this, "Select list", "Names of the dimensions to select, separated by new lines, commas or tabs:", QString(), &ok);
+    if (!ok)
+        return;
+
+    QStringList names = text.split(QRegularExpression("[\\n\\r,\\t]"), Qt::SkipEmptyParts);
+    for (QString& name : names)
+        name = name.trimmed();
+
+    const std::size_t found = _model.selectNames(names);
+    updateSummary();
+    if (found < std::size_t(names.size()))
+        _summaryLabel->setText(_summaryLabel->text() + QString(", %1 names not found").arg(names.size() - found));
+}
+
+std::vector<std::size_t> DimensionPickerDialog::selectedDimensions() const
+{
+    return _model.selectedDimensions();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "csvlabels.h"
+
+#include <QAbstractListModel>
+#include <QDialog>
+#include <QLabel>
+#include <QLineEdit>
+#include <QListView>
+#include <QPushButton>
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// =============================================================================
+// DimensionListModel
+// =============================================================================
+
+// Checkable list of dimension names. Only the dimensions that match the filter are rows of the model,
+// so filtering hundreds of thousands of names only rebuilds an index vector.
+class DimensionListModel : public QAbstractListModel
+{
+    std::vector<QString> _names;
+    std::vector<QString> _hints;
+    std::vector<std::uint8_t> _selected;
+    std::vector<std::uint32_t> _visible;     // index of every row in _names
+    std::size_t _nrOfSelected;
+
+public:
+    DimensionListModel(const ExtCsvLoader::Labels& names, const std::vector<QString>& hints, QObject* parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    bool setData(const QModelIndex& index, const QVariant& value, int role = Qt::EditRole) override;
+    Qt::ItemFlags flags(const QModelIndex& index) const override;
+
+    // an empty or invalid expression shows all dimensions
+    void setFilter(const QString& pattern);
+    void setVisibleSelected(bool selected);
+    // selects exactly the dimensions with one of the given names, returns the number of names that were found
+    std::size_t selectNames(const QStringList& names);
+
+    std::size_t nrOfSelected() const;
+    std::size_t nrOfDimensions() const;
+    std::vector<std::size_t> selectedDimensions() const;
+};
+
+// =============================================================================
+// DimensionPickerDialog
+// =============================================================================
+
+// Lets the user select the dimensions to load directly from the column header, without creating a dataset for it.
+class DimensionPickerDialog : public QDialog
+{
+    DimensionListModel _model;
+    QLineEdit* _filterLineEdit;
+    QListView* _listView;
+    QLabel* _summaryLabel;
+    QPushButton* _okButton;
+
+    void updateSummary();
+    void selectFromList();
+
+public:
+    // hints is empty or holds a short description (e.g. the detected type) of every dimension
+    DimensionPickerDialog(const ExtCsvLoader::Labels& names, const std::vector<QString>& hints, QWidget* parent = nullptr);
+
+    std::vector<std::size_t> selectedDimensions() const;
+};
@@ -1,5 +1,7 @@
 #include "csvbuffer.h"
 
+#include "csvscanner.h"
+
 namespace ExtCsvLoader
 {
 	const char QuoteChar = '\"';
@@ -17,125 +19,122 @@ namespace ExtCsvLoader
 	}
 
 	CsvBuffer::CsvBuffer()
-		:m_empty('\0')
-		,m_separator('\0')
+		:m_separator('\0')
 	{
 	}
-	
+
 	CsvBuffer::CsvBuffer(const char separator)
-		:m_empty('\0')
-		,m_separator(separator)
+		:m_separator(separator)
 	{
 	}
-	
-	CsvBuffer::CsvBuffer(std::string&& input)
-		:m_buffer(std::move(input))
-		,m_empty('\0')
-		,m_separator('\0')
-	{
-	}
-	
-	CsvBuffer::CsvBuffer(std::string&& input, const char separator)
-		:m_buffer(std::move(input))
-		,m_empty('\0')
-		,m_separator(separator)
-	{
-	}
-	
-	CsvBuffer::CsvBuffer(const std::string& input)
+
+	CsvBuffer::CsvBuffer(std::string_view input)
 		:m_buffer(input)
-		,m_empty('\0')
 		,m_separator('\0')
 	{
 	}
-	
-	CsvBuffer::CsvBuffer(const std::string& input, const char separator)
+
+	CsvBuffer::CsvBuffer(std::string_view input, const char separator)
 		:m_buffer(input)
-		,m_empty('\0')
 		,m_separator(separator)
 	{
 	}
-	
-	std::string& CsvBuffer::buffer()
+
+	std::string_view CsvBuffer::buffer() const
 	{
-		m_item.clear();
 		return m_buffer;
 	}
 
-	
+
 	bool CsvBuffer::processed() const
 	{
 		return !m_item.empty();
 	}
 
-	void CsvBuffer::process(const char& separator, std::size_t expectedNrOfItems)
+	void CsvBuffer::process(const char& separator, std::size_t expectedNrOfItems, std::size_t maxNrOfItems)
 	{
 		m_separator = separator;
 		m_item.clear();
+		if (maxNrOfItems == 0)
+			return;
 		if (expectedNrOfItems)
 			m_item.reserve(expectedNrOfItems);
-		std::size_t start_pos = 0;
-		std::size_t end_pos = 0;
+		const char* data = m_buffer.data();
 		const std::size_t positions = m_buffer.size();
+		std::size_t start_pos = 0;
+		// while leading, start_pos still moves over the skip characters and quotes at the start of the item
+		bool leading = true;
+		// an item ends at the first quote that is not at its start
+		std::size_t quote_pos = std::string_view::npos;
 		bool insideQuote = false;
 
-		for (std::size_t pos = 0; pos < positions; ++pos)
+		// remove skip characters at the start, returns true when there is nothing else before pos
+		auto skip_leading = [&](const std::size_t pos)
 		{
-			const char c = m_buffer[pos];
+			while (start_pos < pos && skip_character(data[start_pos]))
+				++start_pos;
+			return start_pos == pos;
+		};
 
-			if (skip_character(c))
+		// only quotes and separators change the state, everything in between is handled when an item is completed
+		for_each_match(m_buffer, QuoteChar, separator, [&](const std::size_t pos)
+		{
+			if (data[pos] == QuoteChar)
 			{
-				// remove skip characters at the start
-				if (start_pos == pos)
+				insideQuote = !insideQuote;
+				if (leading && skip_leading(pos))
+				{
+					start_pos = pos + 1;
+				}
+				else
 				{
-					++start_pos;
+					leading = false;
+					if (quote_pos == std::string_view::npos)
+						quote_pos = pos;
 				}
 			}
-			else
+			else if (!insideQuote)
 			{
-				end_pos = pos;
-				if (c == QuoteChar)
+				if (leading)
+					skip_leading(pos);
+				if (start_pos < pos)
 				{
-					insideQuote = !insideQuote;
-					m_buffer[pos] = '\0';
-					if (start_pos == pos)
-					{
-						++start_pos;
-					}
+					// remove skip characters at the end
+					std::size_t end_pos = pos;
+					while (end_pos > start_pos && skip_character(data[end_pos - 1]))
+						--end_pos;
+					if (quote_pos < end_pos)
+						end_pos = quote_pos;
+					m_item.push_back({ std::uint32_t(start_pos), std::uint32_t(end_pos - start_pos) });
 				}
-				else if (!insideQuote && c == separator)
+				else
 				{
-					if (start_pos < end_pos)
-					{
-						m_buffer[pos] = '\0';
-						if (pos > 0)
-						{
-							// remove skip characters at the end
-							std::size_t p = pos - 1;
-							while (skip_character(m_buffer[p]))
-							{
-								m_buffer[p] = '\0';
-								if (p > 0)
-									--p;
-							}
-						}
-						m_item.push_back(m_buffer.data() + start_pos);
-					}
-					else
-					{
-						m_item.push_back(&m_empty);
-					}
-					start_pos = pos + 1;
+					m_item.push_back({ std::uint32_t(pos), 0 });
 				}
+				start_pos = pos + 1;
+				leading = true;
+				quote_pos = std::string_view::npos;
 			}
+			return m_item.size() < maxNrOfItems;
+		});
 
-		}
-		m_item.push_back(m_buffer.data() + start_pos);
+		if (m_item.size() == maxNrOfItems)
+			return;
+		if (leading)
+			skip_leading(positions);
+		const std::size_t end_pos = (quote_pos < positions) ? quote_pos : positions;
+		m_item.push_back({ std::uint32_t(start_pos), std::uint32_t(end_pos - start_pos) });
+	}
+
+	void CsvBuffer::release()
+	{
+		std::vector<Item>().swap(m_item);
 	}
 
-	const char* CsvBuffer::operator[](const std::size_t _index) const
+	std::string_view CsvBuffer::operator[](const std::size_t _index) const
 	{
-		return m_item[_index];
+		const Item& item = m_item[_index];
+		return m_buffer.substr(item.offset, item.length);
 	}
 
 	std::ptrdiff_t CsvBuffer::size() const
@@ -143,55 +142,31 @@ namespace ExtCsvLoader
 		return m_item.size();
 	}
 
-	void CsvBuffer::getAs(const std::size_t _index, int& v) const
+	void CsvBuffer::getAs(const std::size_t _index, int& v, const NumericPolicy& policy) const
 	{
-		if(m_item[_index])
-			v = atoi(m_item[_index]);
+		parse_number((*this)[_index], v, policy);
 	}
 
-	void CsvBuffer::getAs(const std::size_t _index, float& v) const
+	void CsvBuffer::getAs(const std::size_t _index, float& v, const NumericPolicy& policy) const
 	{
-		if (m_item[_index])
-		{
-			const double d = atof(m_item[_index]);
-			if (d > std::numeric_limits<float>::max())
-				v = std::numeric_limits<float>::max();
-			else if (d < std::numeric_limits<float>::lowest())
-				v = std::numeric_limits<float>::lowest();
-			else
-				v = float(d);
-		}
-			
+		parse_number((*this)[_index], v, policy);
 	}
 
-	void CsvBuffer::getAs(const std::size_t _index, biovault::bfloat16_t & v) const
+	void CsvBuffer::getAs(const std::size_t _index, biovault::bfloat16_t & v, const NumericPolicy& policy) const
 	{
-		float f;
-		getAs(_index, f);
-		v = f;
+		parse_number((*this)[_index], v, policy);
 	}
-	
-
 
-	void CsvBuffer::getAs(const std::size_t _index, double& v) const
+	void CsvBuffer::getAs(const std::size_t _index, double& v, const NumericPolicy& policy) const
 	{
-		if (m_item[_index])
-			v = atof(m_item[_index]);
+		parse_number((*this)[_index], v, policy);
 	}
+
 	void CsvBuffer::getAs(const std::size_t _index, std::string& v) const
 	{
-		if (m_item[_index])
-		{
-			
-			const char* ptr = m_item[_index];
-			auto size = strlen(ptr);
-			v = m_item[_index];
-			//v = std::string(ptr, ptr+size);
-			
-		}
-			
+		v = (*this)[_index];
 	}
 
-	
+
 
 }
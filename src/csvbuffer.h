@@ -1,44 +1,60 @@
 #pragma once
 
-#include <sstream>
+#include <cstdint>
+#include <limits>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "csvnumber.h"
+
 #include <biovault_bfloat16/biovault_bfloat16.h>
 
 namespace ExtCsvLoader
 {
+	// A CsvBuffer does not own its text, it is a view on a single line (e.g. inside a memory mapped file).
+	// The caller has to keep the text alive for as long as the buffer is used.
 	class CsvBuffer
 	{
-		std::string m_buffer;
-		const char m_empty;
-		std::vector<const char*> m_item;
+	public:
+		// location of an item relative to the start of the buffer
+		struct Item
+		{
+			std::uint32_t offset;
+			std::uint32_t length;
+		};
+		// the items are located with 32 bit offsets, so a line can not be longer than this
+		static constexpr std::size_t max_line_size = std::numeric_limits<std::uint32_t>::max();
+
+	private:
+		std::string_view m_buffer;
+		std::vector<Item> m_item;
 		char m_separator;
 
 		bool skip_character(const char c) const;
-		
+
 	public:
 		CsvBuffer();
 		CsvBuffer(const char separator);
-		CsvBuffer(std::string&& input);
-		CsvBuffer(std::string&& input, const char separator);
-		CsvBuffer(const std::string& input);
-		CsvBuffer(const std::string& input, const char separator);
+		CsvBuffer(std::string_view input);
+		CsvBuffer(std::string_view input, const char separator);
 		~CsvBuffer() = default;
-		
-		std::string& buffer();
-		
+
+		std::string_view buffer() const;
+
 		bool processed() const;
-		void process(const char& separator, std::size_t expectedNrOfItems = 0);
-		const char* operator[](const std::size_t _index) const;
+		// splits the line into items, stops after maxNrOfItems items so the rest of a line that is not needed is not scanned
+		void process(const char& separator, std::size_t expectedNrOfItems = 0, std::size_t maxNrOfItems = std::numeric_limits<std::size_t>::max());
+		void release();
+		std::string_view operator[](const std::size_t _index) const;
 		std::ptrdiff_t size() const;
 
-		void getAs(const std::size_t index, int& v) const;
-		void getAs(const std::size_t index, float& v) const;
-		void getAs(const std::size_t index, biovault::bfloat16_t& v) const;
-		void getAs(const std::size_t index, double& v) const;
+		void getAs(const std::size_t index, int& v, const NumericPolicy& policy = {}) const;
+		void getAs(const std::size_t index, float& v, const NumericPolicy& policy = {}) const;
+		void getAs(const std::size_t index, biovault::bfloat16_t& v, const NumericPolicy& policy = {}) const;
+		void getAs(const std::size_t index, double& v, const NumericPolicy& policy = {}) const;
 		void getAs(const std::size_t index, std::string& v) const;
-		
+
 		template<typename T>
 		void getAs(std::vector<T>& result) const;
 	};
@@ -55,4 +71,4 @@ namespace ExtCsvLoader
 		}
 	}
 
-}
\ No newline at end of file
+}
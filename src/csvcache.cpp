@@ -0,0 +1,404 @@
+#include "csvcache.h"
+
+#include <QDebug>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+namespace ExtCsvLoader
+{
+	namespace
+	{
+		constexpr char Magic[8] = { 'C', 'S', 'V', 'C', 'A', 'C', 'H', 'E' };
+		constexpr std::uint32_t Version = 2;
+		constexpr std::uint32_t ByteOrderMark = 0x01020304;		// the cache is only read on the kind of machine that wrote it
+
+		static_assert(sizeof(biovault::bfloat16_t) == 2 && std::is_trivially_copyable_v<biovault::bfloat16_t>);
+
+		// every array is written as its number of elements followed by the elements, padded to a multiple of 8 bytes
+		class CacheWriter
+		{
+			QSaveFile& m_file;
+			std::uint64_t m_pos = 0;
+			bool m_ok = true;
+
+			void raw(const void* data, const std::size_t size)
+			{
+				if (m_ok && size)
+					m_ok = (m_file.write(static_cast<const char*>(data), qint64(size)) == qint64(size));
+				m_pos += size;
+			}
+
+			void align()
+			{
+				constexpr char zeros[8] = {};
+				raw(zeros, (8 - (m_pos % 8)) % 8);
+			}
+
+		public:
+			explicit CacheWriter(QSaveFile& file) : m_file(file) {}
+
+			bool ok() const
+			{
+				return m_ok;
+			}
+
+			template <typename T>
+			void value(const T& v)
+			{
+				raw(&v, sizeof(T));
+				align();
+			}
+
+			template <typename T>
+			void array(const T* data, const std::size_t count)
+			{
+				value(std::uint64_t(count));
+				raw(data, count * sizeof(T));
+				align();
+			}
+
+			void string(const std::string_view s)
+			{
+				array(s.data(), s.size());
+			}
+
+			void strings(const std::vector<std::string>& v)
+			{
+				std::vector<std::uint64_t> offsets(v.size() + 1, 0);
+				for (std::size_t i = 0; i < v.size(); ++i)
+					offsets[i + 1] = offsets[i] + v[i].size();
+
+				std::string chars;
+				chars.reserve(offsets.back());
+				for (const std::string& s : v)
+					chars += s;
+
+				array(offsets.data(), offsets.size());
+				string(chars);
+			}
+
+			// the same layout as strings, written as it is
+			void labels(const Labels& v)
+			{
+				const std::uint64_t no_labels = 0;
+				if (v.offsets().empty())
+					array(&no_labels, 1);
+				else
+					array(v.offsets().data(), v.offsets().size());
+				string(v.text());
+			}
+		};
+
+		// reads what CacheWriter wrote, every read is checked against the end of the file. The arrays are read straight
+		// into the vectors they end up in, so the cache is never held in memory next to the loaded columns
+		class CacheReader
+		{
+			QFile& m_file;
+			std::uint64_t m_pos;
+			std::uint64_t m_end;
+			bool m_ok;
+
+			bool read(void* data, const std::size_t size)
+			{
+				if (!m_ok || size > m_end - m_pos || (size && m_file.read(static_cast<char*>(data), qint64(size)) != qint64(size)))
+				{
+					m_ok = false;
+					return false;
+				}
+				m_pos += size;
+				return true;
+			}
+
+			void align()
+			{
+				char padding[8];
+				read(padding, (8 - (m_pos % 8)) % 8);
+			}
+
+			// the number of elements of an array, checked against what is left of the file
+			template <typename T>
+			std::size_t count()
+			{
+				std::uint64_t count = 0;
+				if (!value(count) || count > (m_end - m_pos) / sizeof(T))
+				{
+					m_ok = false;
+					return 0;
+				}
+				return count;
+			}
+
+		public:
+			CacheReader(QFile& file, const std::uint64_t pos) : m_file(file), m_pos(pos), m_end(std::uint64_t(file.size())), m_ok(file.seek(qint64(pos))) {}
+
+			bool ok() const
+			{
+				return m_ok;
+			}
+
+			std::uint64_t pos() const
+			{
+				return m_pos;
+			}
+
+			template <typename T>
+			bool value(T& v)
+			{
+				read(&v, sizeof(T));
+				align();
+				return m_ok;
+			}
+
+			template <typename T>
+			bool array(std::vector<T>& v)
+			{
+				v.resize(count<T>());
+				read(v.data(), v.size() * sizeof(T));
+				align();
+				if (!m_ok)
+					v.clear();
+				return m_ok;
+			}
+
+			std::string string()
+			{
+				std::string s(count<char>(), '\0');
+				read(s.data(), s.size());
+				align();
+				return m_ok ? s : std::string();
+			}
+
+			bool strings(std::vector<std::string>& v)
+			{
+				std::vector<std::uint64_t> offsets;
+				array(offsets);
+				const std::string chars = string();
+				if (!m_ok || offsets.empty() || offsets.front() != 0 || offsets.back() != chars.size() || !std::is_sorted(offsets.cbegin(), offsets.cend()))
+				{
+					m_ok = false;
+					return false;
+				}
+				v.resize(offsets.size() - 1);
+				for (std::size_t i = 0; i < v.size(); ++i)
+					v[i] = chars.substr(offsets[i], offsets[i + 1] - offsets[i]);
+				return true;
+			}
+
+			bool labels(Labels& v)
+			{
+				std::vector<std::uint64_t> offsets;
+				array(offsets);
+				std::string chars = string();
+				if (!m_ok || !v.assign(std::move(chars), std::move(offsets)))
+				{
+					m_ok = false;
+					return false;
+				}
+				return true;
+			}
+		};
+
+		// the numerical data is stored with the index of its type in NumericalData
+		template <std::size_t... Index>
+		bool numerical_data_of_type(const std::size_t type, NumericalData& data, std::index_sequence<Index...>)
+		{
+			return ((type == Index && (data.emplace<Index>(), true)) || ...);
+		}
+
+		bool numerical_data_of_type(const std::size_t type, NumericalData& data)
+		{
+			return numerical_data_of_type(type, data, std::make_index_sequence<std::variant_size_v<NumericalData>>());
+		}
+
+		void append_labels(std::string& key, const std::vector<std::string>& labels)
+		{
+			key += std::to_string(labels.size()) + '\n';
+			for (const std::string& label : labels)
+				key += std::to_string(label.size()) + ':' + label;
+			key += '\n';
+		}
+	}
+
+	QString cache_file_name(const QString& filename)
+	{
+		return filename + ".mvcache";
+	}
+
+	std::string source_key(const QString& filename, const std::string& options)
+	{
+		const QFileInfo info(filename);
+		if (!info.exists())
+			return {};
+		return info.absoluteFilePath().toStdString() + '\n' + std::to_string(info.size()) + '\n' + std::to_string(info.lastModified().toMSecsSinceEpoch()) + '\n' + options;
+	}
+
+	std::string selection_key(const std::vector<std::string>& parent_labels, const std::vector<std::string>& dimension_labels)
+	{
+		std::string key;
+		append_labels(key, parent_labels);
+		append_labels(key, dimension_labels);
+		return key;
+	}
+
+	CsvCache::CsvCache(const QString& filename)
+		: m_file(filename)
+		, m_columns(0)
+	{
+	}
+
+	bool CsvCache::open(const std::string& source_key)
+	{
+		if (source_key.empty() || !m_file.open(QIODevice::ReadOnly | QIODevice::Unbuffered))
+			return false;
+
+		CacheReader reader(m_file, 0);
+		char magic[sizeof(Magic)];
+		std::uint32_t version = 0;
+		std::uint32_t byte_order_mark = 0;
+		if (!reader.value(magic) || !std::equal(std::begin(Magic), std::end(Magic), magic) || !reader.value(version) || version != Version || !reader.value(byte_order_mark) || byte_order_mark != ByteOrderMark)
+			return false;
+		if (reader.string() != source_key)
+			return false;
+		m_selection_key = reader.string();
+		if (!reader.labels(m_source_column_header))
+			return false;
+
+		m_columns = reader.pos();
+		return true;
+	}
+
+	const Labels& CsvCache::source_column_header() const
+	{
+		return m_source_column_header;
+	}
+
+	bool CsvCache::load(const std::string& selection_key, TypedColumns& result)
+	{
+		if (m_columns == 0 || m_selection_key != selection_key)
+			return false;
+
+		result = TypedColumns();
+		CacheReader reader(m_file, m_columns);
+		reader.labels(result.column_header);
+		reader.labels(result.row_header);
+		reader.array(result.types);
+
+		std::vector<std::uint64_t> numerical_columns;
+		reader.array(numerical_columns);
+		result.numerical_columns.assign(numerical_columns.cbegin(), numerical_columns.cend());
+
+		std::uint8_t storage = 0;
+		reader.value(storage);
+		if (!numerical_data_of_type(storage, result.numerical_data))
+			return false;
+		std::visit([&reader](auto& numerical_data) { reader.array(numerical_data); }, result.numerical_data);
+		reader.array(result.sparse_data.offsets);
+		reader.array(result.sparse_data.columns);
+		reader.array(result.sparse_data.values);
+
+		std::uint64_t nrOfCategorical = 0;
+		reader.value(nrOfCategorical);
+		if (!reader.ok() || nrOfCategorical != result.types.size())
+			return false;
+		result.categorical.resize(nrOfCategorical);
+		for (CategoricalColumn& column : result.categorical)
+		{
+			reader.strings(column.values);
+			reader.array(column.codes);
+		}
+		if (!reader.ok())
+			return false;
+
+		// a damaged cache must not lead to out of range indices later on
+		const std::size_t nrOfColumns = result.column_header.size();
+		const std::size_t nrOfRows = result.row_header.size();
+		const std::size_t numerical_size = std::visit([](const auto& numerical_data) { return numerical_data.size(); }, result.numerical_data);
+		bool valid = (result.types.size() == nrOfColumns) && std::all_of(result.types.cbegin(), result.types.cend(), [](ColumnType type) { return type <= ColumnType::Color; });
+		if (is_sparse(result))
+		{
+			const SparseRows& sparse = result.sparse_data;
+			valid = valid && (numerical_size == 0) && (sparse.offsets.size() == nrOfRows + 1) && (sparse.offsets.front() == 0) && std::is_sorted(sparse.offsets.cbegin(), sparse.offsets.cend())
+				&& (sparse.offsets.back() == sparse.columns.size()) && (sparse.columns.size() == sparse.values.size())
+				&& std::all_of(sparse.columns.cbegin(), sparse.columns.cend(), [&result](std::uint32_t column) { return column < result.numerical_columns.size(); });
+		}
+		else
+		{
+			valid = valid && (numerical_size == nrOfRows * result.numerical_columns.size());
+		}
+		for (const std::size_t column : result.numerical_columns)
+			valid = valid && (column < nrOfColumns) && (result.types[column] == ColumnType::Numerical);
+		for (std::size_t column = 0; valid && column < nrOfColumns; ++column)
+		{
+			const CategoricalColumn& categorical = result.categorical[column];
+			if (result.types[column] == ColumnType::Categorical || result.types[column] == ColumnType::Color)
+				valid = (categorical.codes.size() == nrOfRows) && std::all_of(categorical.codes.cbegin(), categorical.codes.cend(), [&categorical](std::uint32_t code) { return code < categorical.values.size(); });
+		}
+		if (!valid)
+		{
+			qWarning() << "Ignoring damaged cache file " << m_file.fileName();
+			result = TypedColumns();
+			return false;
+		}
+
+		qDebug() << nrOfColumns << " x " << nrOfRows << " typed columns loaded from cache " << m_file.fileName();
+		return true;
+	}
+
+	void CsvCache::close()
+	{
+		// the file has to be closed before it can be replaced by a new cache
+		m_file.close();
+		m_columns = 0;
+		m_selection_key.clear();
+	}
+
+	bool CsvCache::write(const QString& filename, const std::string& source_key, const Labels& source_column_header, const std::string& selection_key, const TypedColumns& columns)
+	{
+		if (source_key.empty())
+			return false;
+
+		// QSaveFile only replaces an existing cache once everything is written
+		QSaveFile file(filename);
+		if (!file.open(QIODevice::WriteOnly))
+			return false;
+
+		CacheWriter writer(file);
+		writer.value(Magic);
+		writer.value(Version);
+		writer.value(ByteOrderMark);
+		writer.string(source_key);
+		writer.string(selection_key);
+		writer.labels(source_column_header);
+
+		writer.labels(columns.column_header);
+		writer.labels(columns.row_header);
+		writer.array(columns.types.data(), columns.types.size());
+
+		const std::vector<std::uint64_t> numerical_columns(columns.numerical_columns.cbegin(), columns.numerical_columns.cend());
+		writer.array(numerical_columns.data(), numerical_columns.size());
+
+		writer.value(std::uint8_t(columns.numerical_data.index()));
+		std::visit([&writer](const auto& numerical_data) { writer.array(numerical_data.data(), numerical_data.size()); }, columns.numerical_data);
+		writer.array(columns.sparse_data.offsets.data(), columns.sparse_data.offsets.size());
+		writer.array(columns.sparse_data.columns.data(), columns.sparse_data.columns.size());
+		writer.array(columns.sparse_data.values.data(), columns.sparse_data.values.size());
+
+		writer.value(std::uint64_t(columns.categorical.size()));
+		for (const CategoricalColumn& column : columns.categorical)
+		{
+			writer.strings(column.values);
+			writer.array(column.codes.data(), column.codes.size());
+		}
+
+		if (!writer.ok() || !file.commit())
+		{
+			qWarning() << "Could not write cache file " << filename;
+			return false;
+		}
+		return true;
+	}
+}
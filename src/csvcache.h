@@ -0,0 +1,49 @@
+#pragma once
+
+#include "csvcolumns.h"
+
+#include <QFile>
+#include <QString>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ExtCsvLoader
+{
+	// name of the cache file that belongs to a csv file, it is kept next to it
+	QString cache_file_name(const QString& filename);
+
+	// identifies the csv file (absolute path, size and modification time) together with the options it is read with,
+	// empty when the file does not exist
+	std::string source_key(const QString& filename, const std::string& options);
+
+	// identifies the selected rows and columns
+	std::string selection_key(const std::vector<std::string>& parent_labels, const std::vector<std::string>& dimension_labels);
+
+	// A binary copy of the TypedColumns of a load, all arrays are 8 byte aligned. The arrays are read from the file
+	// straight into the vectors that the datasets take over, so a load from the cache takes no more memory than the data.
+	// The column header of the csv file itself is kept as well, so the dimension selection does not need the csv file.
+	class CsvCache
+	{
+		QFile m_file;
+		std::string m_selection_key;
+		Labels m_source_column_header;
+		std::uint64_t m_columns;	// position of the typed columns in the file
+
+	public:
+		explicit CsvCache(const QString& filename);
+		~CsvCache() = default;
+
+		// true when the cache was written for the same source key
+		bool open(const std::string& source_key);
+		const Labels& source_column_header() const;
+
+		// true when the cache was also written for the same selection, the cached columns are then copied into result
+		bool load(const std::string& selection_key, TypedColumns& result);
+		void close();
+
+		static bool write(const QString& filename, const std::string& source_key, const Labels& source_column_header, const std::string& selection_key, const TypedColumns& columns);
+	};
+}
@@ -0,0 +1,949 @@
+#include "csvcolumns.h"
+
+#include "csvnumber.h"
+
+#include <QColor>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <string_view>
+#include <unordered_map>
+
+namespace ExtCsvLoader
+{
+	namespace
+	{
+		constexpr std::string_view MissingValue("N/A");
+
+		// the rows that decide whether SparseMode::Auto loads sparse data
+		constexpr std::size_t SparseSampleRows = 100;
+
+		// about the number of rows the types are detected on when they are sampled
+		constexpr std::size_t TypeSampleRows = 1000;
+
+		// the code of a categorical cell that is not in the file, e.g. of a parent label that is not found, it is an empty cell
+		constexpr std::uint32_t MissingCell = std::numeric_limits<std::uint32_t>::max();
+
+		// distinct values whose color check is remembered per thread, enough for the labels of a column
+		constexpr std::size_t ColorMemoSize = 4096;
+
+		// the row whose numbers a thread is parsing, on a cache line of its own, -1 before its first row
+		struct alignas(64) ParsingRow
+		{
+			std::ptrdiff_t row = -1;
+		};
+
+		enum : std::uint8_t { NotNumerical = 1, NotColor = 2 };
+
+		// open addressing hash map from the distinct values of a column to their code, codes are given in order of appearance
+		class StringDictionary
+		{
+			std::vector<std::uint32_t> m_slots;		// code + 1, or 0 for an empty slot
+			std::vector<std::string_view> m_values;
+			std::vector<std::size_t> m_hashes;
+
+			void grow()
+			{
+				std::vector<std::uint32_t>(std::max<std::size_t>(64, 2 * m_slots.size()), 0).swap(m_slots);
+				const std::size_t mask = m_slots.size() - 1;
+				for (std::size_t code = 0; code < m_values.size(); ++code)
+				{
+					std::size_t slot = m_hashes[code] & mask;
+					while (m_slots[slot] != 0)
+						slot = (slot + 1) & mask;
+					m_slots[slot] = std::uint32_t(code + 1);
+				}
+			}
+
+		public:
+			std::uint32_t intern(const std::string_view value)
+			{
+				// keep the load factor below one half
+				if (2 * (m_values.size() + 1) > m_slots.size())
+					grow();
+
+				const std::size_t hash = std::hash<std::string_view>()(value);
+				const std::size_t mask = m_slots.size() - 1;
+				for (std::size_t slot = hash & mask;; slot = (slot + 1) & mask)
+				{
+					const std::uint32_t entry = m_slots[slot];
+					if (entry == 0)
+					{
+						m_values.push_back(value);
+						m_hashes.push_back(hash);
+						m_slots[slot] = std::uint32_t(m_values.size());
+						return std::uint32_t(m_values.size() - 1);
+					}
+					if (m_hashes[entry - 1] == hash && m_values[entry - 1] == value)
+						return entry - 1;
+				}
+			}
+
+			const std::vector<std::string_view>& values() const
+			{
+				return m_values;
+			}
+		};
+
+		bool is_hex_digit(const char c)
+		{
+			return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+		}
+
+		// #RGB, #RRGGBB, #AARRGGBB, #RRRGGGBBB and #RRRRGGGGBBBB are checked here, only names go through QColor
+		bool is_color(const std::string_view item)
+		{
+			if (!item.empty() && item.front() == '#')
+			{
+				const std::size_t digits = item.size() - 1;
+				return (digits == 3 || digits == 6 || digits == 8 || digits == 9 || digits == 12) && std::all_of(item.cbegin() + 1, item.cend(), is_hex_digit);
+			}
+			return QColor::isValidColor(QString::fromUtf8(item.data(), qsizetype(item.size())));
+		}
+
+		// Merges the dictionaries the threads interned the cells of a column into, dictionary thread * stride of dictionaries
+		// for the cells of the lines thread line_thread[line] did. The values become sorted, so the clusters are in alphabetical
+		// order, and empty cells become N/A, as do the cells coded MissingCell. Returns whether all values are colors (empty cells excepted), which is checked once
+		// per distinct value instead of once per cell.
+		bool merge_dictionaries(const StringDictionary* dictionaries, const std::size_t stride, const std::size_t nrOfThreads, const std::vector<std::uint32_t>& line_thread, const bool transposed, const std::size_t column, CategoricalColumn& result)
+		{
+			std::vector<std::string_view> values;
+			for (std::size_t thread = 0; thread < nrOfThreads; ++thread)
+			{
+				const std::vector<std::string_view>& thread_values = dictionaries[thread * stride].values();
+				values.insert(values.end(), thread_values.cbegin(), thread_values.cend());
+			}
+			if (std::find(result.codes.cbegin(), result.codes.cend(), MissingCell) != result.codes.cend())
+				values.emplace_back();
+			std::sort(values.begin(), values.end());
+			values.erase(std::unique(values.begin(), values.end()), values.end());
+
+			// a cell that literally says N/A is not a color, empty cells are checked before they become N/A
+			const bool colors = std::all_of(values.cbegin(), values.cend(), [](std::string_view value) { return value.empty() || is_color(value); });
+			if (!values.empty() && values.front().empty())
+			{
+				values.erase(values.begin());
+				const auto position = std::lower_bound(values.begin(), values.end(), MissingValue);
+				if (position == values.end() || *position != MissingValue)
+					values.insert(position, MissingValue);
+			}
+
+			std::vector<std::vector<std::uint32_t>> sorted_code(nrOfThreads);
+			for (std::size_t thread = 0; thread < nrOfThreads; ++thread)
+			{
+				const std::vector<std::string_view>& thread_values = dictionaries[thread * stride].values();
+				sorted_code[thread].resize(thread_values.size());
+				for (std::size_t code = 0; code < thread_values.size(); ++code)
+				{
+					const std::string_view value = thread_values[code].empty() ? MissingValue : thread_values[code];
+					sorted_code[thread][code] = std::uint32_t(std::lower_bound(values.cbegin(), values.cend(), value) - values.cbegin());
+				}
+			}
+			const std::uint32_t missing_code = std::uint32_t(std::lower_bound(values.cbegin(), values.cend(), MissingValue) - values.cbegin());
+			for (std::size_t row = 0; row < result.codes.size(); ++row)
+			{
+				const std::uint32_t code = result.codes[row];
+				result.codes[row] = (code == MissingCell) ? missing_code : sorted_code[line_thread[transposed ? column : row]][code];
+			}
+
+			result.values.assign(values.cbegin(), values.cend());
+			return colors;
+		}
+
+		// Each thread keeps its own flags per column, a column is numerical or a color as long as none of its items says otherwise.
+		// Without detect_colors a column is numerical or categorical, the colors are then found among the distinct values later on.
+		std::vector<ColumnType> detect_types(CSVReader& reader, bool transposed, Labels& column_header, Labels& row_header, const std::vector<std::string>& parent_labels, const std::vector<std::string>& dimension_labels, bool autodetect, bool detect_colors, std::size_t row_step = 1)
+		{
+			std::vector<std::vector<std::uint8_t>> thread_flags(omp_get_max_threads());
+			std::vector<std::unordered_map<std::string_view, bool>> color_memo(detect_colors ? omp_get_max_threads() : 0);
+			const std::uint8_t initial_flags = (autodetect ? 0 : NotNumerical) | (detect_colors ? 0 : NotColor);
+			reader.for_each_cell("Detecting types", transposed, column_header, row_header, parent_labels, dimension_labels, [&](std::size_t, std::size_t column, std::string_view item)
+			{
+				std::vector<std::uint8_t>& flags = thread_flags[omp_get_thread_num()];
+				if (column >= flags.size())
+					flags.resize(column + 1, initial_flags);
+
+				std::uint8_t& flag = flags[column];
+				if (item.empty() || flag == (NotNumerical | NotColor))
+					return;
+				if (!(flag & NotNumerical) && !is_number(item))
+					flag |= NotNumerical;
+				if (!(flag & NotColor))
+				{
+					// label columns repeat a few values, every distinct value is only looked up once
+					auto& memo = color_memo[omp_get_thread_num()];
+					const auto found = memo.find(item);
+					const bool color = (found != memo.cend()) ? found->second : is_color(item);
+					if (found == memo.cend() && memo.size() < ColorMemoSize)
+						memo.emplace(item, color);
+					if (!color)
+						flag |= NotColor;
+				}
+			}, row_step);
+
+			std::vector<ColumnType> types(column_header.size(), ColumnType::Unknown);
+			for (std::size_t column = 0; column < types.size(); ++column)
+			{
+				std::uint8_t flag = initial_flags;
+				for (const auto& flags : thread_flags)
+					if (column < flags.size())
+						flag |= flags[column];
+
+				if (!(flag & NotNumerical))
+					types[column] = ColumnType::Numerical;
+				else if (!(flag & NotColor))
+					types[column] = ColumnType::Color;
+				else
+					types[column] = ColumnType::Categorical;
+			}
+			return types;
+		}
+
+		// the type a storage keeps its numbers in, float for the storages that depend on all values
+		NumericalData stored_data(const NumericalStorage storage)
+		{
+			switch (storage)
+			{
+			case NumericalStorage::BFloat16:
+				return std::vector<biovault::bfloat16_t>();
+			case NumericalStorage::Int8:
+				return std::vector<std::int8_t>();
+			case NumericalStorage::UInt8:
+				return std::vector<std::uint8_t>();
+			case NumericalStorage::Int16:
+				return std::vector<std::int16_t>();
+			case NumericalStorage::UInt16:
+				return std::vector<std::uint16_t>();
+			case NumericalStorage::Int32:
+				return std::vector<std::int32_t>();
+			default:
+				return std::vector<float>();
+			}
+		}
+
+		// the type the numbers are parsed into, transformed numbers are parsed as float first
+		NumericalData parsed_data(const NumericalStorage storage, const bool transformed)
+		{
+			return transformed ? NumericalData(std::vector<float>()) : stored_data(storage);
+		}
+
+		// a value of sparse or float data in the final type, integers are rounded and saturated like parse_number does
+		template <typename T>
+		T convert_value(const float value)
+		{
+			if constexpr (std::is_integral_v<T>)
+			{
+				if (std::isnan(value))
+					return T(0);
+				if (double(value) >= double(std::numeric_limits<T>::max()))
+					return std::numeric_limits<T>::max();
+				if (double(value) <= double(std::numeric_limits<T>::min()))
+					return std::numeric_limits<T>::min();
+				return T(std::lround(value));
+			}
+			else
+			{
+				return T(value);
+			}
+		}
+
+		// the smallest integer type for values in [lowest, highest], empty data of that type, or float when there is none
+		NumericalData integral_data(const double lowest, const double highest)
+		{
+			auto fits = [lowest, highest](auto type)
+			{
+				using T = decltype(type);
+				return lowest >= double(std::numeric_limits<T>::min()) && highest <= double(std::numeric_limits<T>::max());
+			};
+			if (fits(std::uint8_t()))
+				return std::vector<std::uint8_t>();
+			if (fits(std::int8_t()))
+				return std::vector<std::int8_t>();
+			if (fits(std::uint16_t()))
+				return std::vector<std::uint16_t>();
+			if (fits(std::int16_t()))
+				return std::vector<std::int16_t>();
+			if (fits(std::int32_t()))
+				return std::vector<std::int32_t>();
+			return std::vector<float>();
+		}
+
+		// the range of the values, false when not all of them are finite integers
+		bool integral_range(const std::vector<float>& values, double& lowest, double& highest)
+		{
+			float low = 0;
+			float high = 0;
+			bool integral = true;
+			#pragma omp parallel for reduction(min:low) reduction(max:high) reduction(&&:integral)
+			for (std::ptrdiff_t i = 0; i < std::ptrdiff_t(values.size()); ++i)
+			{
+				const float value = values[i];
+				integral = integral && std::isfinite(value) && (std::trunc(value) == value);
+				low = std::min(low, value);
+				high = std::max(high, value);
+			}
+			lowest = low;
+			highest = high;
+			return integral;
+		}
+
+		// Offset and scale per numerical column that map its range onto the codes 0 up to max_code. values holds the
+		// numbers of column columns[i] (or of column i % nrOfColumns without columns) and NaN is left out of the range.
+		void quantization_ranges(const std::vector<float>& values, const std::vector<std::uint32_t>* columns, const std::size_t nrOfColumns, const float max_code, const bool with_zero, TypedColumns& result)
+		{
+			const std::size_t nrOfThreads = omp_get_max_threads();
+			std::vector<float> lowest(nrOfThreads * nrOfColumns, std::numeric_limits<float>::infinity());
+			std::vector<float> highest(nrOfThreads * nrOfColumns, -std::numeric_limits<float>::infinity());
+			#pragma omp parallel
+			{
+				float* low = lowest.data() + (omp_get_thread_num() * nrOfColumns);
+				float* high = highest.data() + (omp_get_thread_num() * nrOfColumns);
+				#pragma omp for schedule(static)
+				for (std::ptrdiff_t i = 0; i < std::ptrdiff_t(values.size()); ++i)
+				{
+					const std::size_t column = columns ? (*columns)[i] : (std::size_t(i) % nrOfColumns);
+					if (values[i] < low[column])
+						low[column] = values[i];
+					if (values[i] > high[column])
+						high[column] = values[i];
+				}
+			}
+
+			result.quantization_offset.assign(nrOfColumns, 0.0f);
+			result.quantization_scale.assign(nrOfColumns, 0.0f);
+			for (std::size_t column = 0; column < nrOfColumns; ++column)
+			{
+				float low = with_zero ? 0.0f : std::numeric_limits<float>::infinity();
+				float high = with_zero ? 0.0f : -std::numeric_limits<float>::infinity();
+				for (std::size_t thread = 0; thread < nrOfThreads; ++thread)
+				{
+					low = std::min(low, lowest[(thread * nrOfColumns) + column]);
+					high = std::max(high, highest[(thread * nrOfColumns) + column]);
+				}
+				// a column without numbers keeps offset and scale 0
+				if (low <= high)
+				{
+					result.quantization_offset[column] = low;
+					result.quantization_scale[column] = (high - low) / max_code;
+				}
+			}
+		}
+
+		template <typename T>
+		T quantize(const float value, const float offset, const float scale)
+		{
+			if (scale == 0.0f || std::isnan(value))
+				return T(0);
+			return convert_value<T>(std::clamp((value - offset) / scale, 0.0f, float(std::numeric_limits<T>::max())));
+		}
+
+		// the float values as the type of data, sparse values are converted by densify
+		void convert_values(TypedColumns& columns, const std::vector<float>& values, const bool sparse, NumericalData data)
+		{
+			if (sparse)
+			{
+				columns.numerical_data = std::move(data);
+				return;
+			}
+			std::visit([&columns, &values](auto& converted)
+			{
+				using T = typename std::decay_t<decltype(converted)>::value_type;
+				if constexpr (!std::is_same_v<T, float>)
+				{
+					converted.resize(values.size());
+					#pragma omp parallel for schedule(static)
+					for (std::ptrdiff_t i = 0; i < std::ptrdiff_t(converted.size()); ++i)
+						converted[i] = convert_value<T>(values[i]);
+					columns.numerical_data = std::move(converted);
+				}
+			}, data);
+		}
+
+		std::vector<float> float_values(const NumericalData& data)
+		{
+			return std::visit([](const auto& values)
+			{
+				std::vector<float> result(values.size());
+				#pragma omp parallel for schedule(static)
+				for (std::ptrdiff_t i = 0; i < std::ptrdiff_t(result.size()); ++i)
+					result[i] = float(values[i]);
+				return result;
+			}, data);
+		}
+
+		// Normalizes every column of the row major values in place, NaN is left out and stays NaN. The statistics are
+		// gathered per thread in a single pass, a column with a single distinct value becomes 0.
+		void normalize(std::vector<float>& values, const std::size_t nrOfColumns, const Normalization normalization)
+		{
+			if (nrOfColumns == 0 || normalization == Normalization::None)
+				return;
+
+			const std::size_t nrOfThreads = omp_get_max_threads();
+			const std::ptrdiff_t nrOfRows = std::ptrdiff_t(values.size() / nrOfColumns);
+			// ZScore: count, sum and sum of squares, MinMax: lowest and highest value
+			std::vector<double> statistics(nrOfThreads * 3 * nrOfColumns, 0.0);
+			if (normalization == Normalization::MinMax)
+			{
+				for (std::size_t thread = 0; thread < nrOfThreads; ++thread)
+				{
+					double* thread_statistics = statistics.data() + (thread * 3 * nrOfColumns);
+					std::fill_n(thread_statistics, nrOfColumns, std::numeric_limits<double>::infinity());
+					std::fill_n(thread_statistics + nrOfColumns, nrOfColumns, -std::numeric_limits<double>::infinity());
+				}
+			}
+			#pragma omp parallel
+			{
+				double* first = statistics.data() + (omp_get_thread_num() * 3 * nrOfColumns);
+				double* second = first + nrOfColumns;
+				double* third = second + nrOfColumns;
+				#pragma omp for schedule(static)
+				for (std::ptrdiff_t row = 0; row < nrOfRows; ++row)
+				{
+					const float* row_values = values.data() + (row * nrOfColumns);
+					for (std::size_t column = 0; column < nrOfColumns; ++column)
+					{
+						const double value = row_values[column];
+						if (std::isnan(value))
+							continue;
+						if (normalization == Normalization::ZScore)
+						{
+							first[column] += 1.0;
+							second[column] += value;
+							third[column] += value * value;
+						}
+						else
+						{
+							first[column] = std::min(first[column], value);
+							second[column] = std::max(second[column], value);
+						}
+					}
+				}
+			}
+
+			// value = (value - offset) * factor
+			std::vector<float> offset(nrOfColumns, 0.0f);
+			std::vector<float> factor(nrOfColumns, 0.0f);
+			for (std::size_t column = 0; column < nrOfColumns; ++column)
+			{
+				double first = statistics[column];
+				double second = statistics[nrOfColumns + column];
+				double third = statistics[(2 * nrOfColumns) + column];
+				for (std::size_t thread = 1; thread < nrOfThreads; ++thread)
+				{
+					const double* thread_statistics = statistics.data() + (thread * 3 * nrOfColumns);
+					if (normalization == Normalization::ZScore)
+					{
+						first += thread_statistics[column];
+						second += thread_statistics[nrOfColumns + column];
+						third += thread_statistics[(2 * nrOfColumns) + column];
+					}
+					else
+					{
+						first = std::min(first, thread_statistics[column]);
+						second = std::max(second, thread_statistics[nrOfColumns + column]);
+					}
+				}
+				if (normalization == Normalization::ZScore)
+				{
+					const double mean = (first > 0.0) ? (second / first) : 0.0;
+					const double variance = (first > 0.0) ? std::max(0.0, (third / first) - (mean * mean)) : 0.0;
+					offset[column] = float(mean);
+					factor[column] = (variance > 0.0) ? float(1.0 / std::sqrt(variance)) : 0.0f;
+				}
+				else if (first < second)
+				{
+					offset[column] = float(first);
+					factor[column] = float(1.0 / (second - first));
+				}
+			}
+
+			const float* offset_data = offset.data();
+			const float* factor_data = factor.data();
+			#pragma omp parallel for schedule(static)
+			for (std::ptrdiff_t row = 0; row < nrOfRows; ++row)
+			{
+				float* row_values = values.data() + (row * nrOfColumns);
+				#pragma omp simd
+				for (std::size_t column = 0; column < nrOfColumns; ++column)
+					row_values[column] = (row_values[column] - offset_data[column]) * factor_data[column];
+			}
+		}
+	}
+
+	std::size_t ClusterIndices::size() const
+	{
+		return offsets.empty() ? 0 : offsets.size() - 1;
+	}
+
+	std::span<const std::uint32_t> ClusterIndices::operator[](const std::size_t value) const
+	{
+		return std::span<const std::uint32_t>(rows.data() + offsets[value], offsets[value + 1] - offsets[value]);
+	}
+
+	ClusterIndices cluster_indices(const CategoricalColumn& column)
+	{
+		ClusterIndices result;
+		result.offsets.assign(column.values.size() + 1, 0);
+		for (const std::uint32_t code : column.codes)
+			++result.offsets[code + 1];
+		std::partial_sum(result.offsets.begin(), result.offsets.end(), result.offsets.begin());
+
+		// visiting the rows in order keeps the rows of every value sorted
+		std::vector<std::uint32_t> next(result.offsets.begin(), result.offsets.end() - 1);
+		result.rows.resize(column.codes.size());
+		for (std::size_t row = 0; row < column.codes.size(); ++row)
+			result.rows[next[column.codes[row]]++] = std::uint32_t(row);
+		return result;
+	}
+
+	std::uint64_t partition_signature(const CategoricalColumn& column)
+	{
+		// relabel the codes in order of first appearance, so the signature does not depend on the values
+		constexpr std::uint32_t unlabeled = std::numeric_limits<std::uint32_t>::max();
+		std::vector<std::uint32_t> label(column.values.size(), unlabeled);
+		std::uint32_t next_label = 0;
+
+		// 64 bit FNV-1a over the relabeled codes
+		std::uint64_t hash = 0xcbf29ce484222325ull;
+		for (const std::uint32_t code : column.codes)
+		{
+			if (label[code] == unlabeled)
+				label[code] = next_label++;
+			hash = (hash ^ label[code]) * 0x100000001b3ull;
+		}
+		return (hash ^ next_label) * 0x100000001b3ull;
+	}
+
+	bool same_partition(const CategoricalColumn& a, const CategoricalColumn& b, std::vector<std::uint32_t>& value_map)
+	{
+		if (a.values.size() != b.values.size() || a.codes.size() != b.codes.size())
+			return false;
+
+		constexpr std::uint32_t unmapped = std::numeric_limits<std::uint32_t>::max();
+		value_map.assign(a.values.size(), unmapped);
+		std::vector<std::uint32_t> inverse_map(b.values.size(), unmapped);
+		for (std::size_t row = 0; row < a.codes.size(); ++row)
+		{
+			const std::uint32_t code_a = a.codes[row];
+			const std::uint32_t code_b = b.codes[row];
+			if (value_map[code_a] == unmapped)
+			{
+				if (inverse_map[code_b] != unmapped)
+					return false;
+				value_map[code_a] = code_b;
+				inverse_map[code_b] = code_a;
+			}
+			else if (value_map[code_a] != code_b)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	std::vector<ColumnType> detect_column_types(CSVReader& reader, bool autodetect)
+	{
+		if (reader.rows() == 0 || reader.columns() == 0)
+			return {};
+
+		Labels column_header;
+		Labels row_header;
+		return detect_types(reader, false, column_header, row_header, {}, {}, autodetect, true);
+	}
+
+	bool load_numerical_columns(CSVReader& reader, bool transposed, const std::vector<std::string>& parent_labels, const std::vector<std::string>& dimension_labels, NumericalStorage storage, SparseMode sparse, TypedColumns& result)
+	{
+		result = TypedColumns();
+		if (sparse == SparseMode::Auto)
+		{
+			// a sparse value takes a column index next to its float, the dense data only the value in its storage
+			const std::size_t value_size = std::visit([](const auto& numerical_data) { return sizeof(numerical_data[0]); }, parsed_data(storage, reader.transform() != CSVReader::TRANSFORM::NONE));
+			const double max_density = double(value_size) / (2.0 * (sizeof(std::uint32_t) + sizeof(float)));
+			const double zeros = reader.zero_fraction(SparseSampleRows);
+			sparse = (1.0 - zeros <= max_density) ? SparseMode::Sparse : SparseMode::Dense;
+			qDebug() << "Zeros in the first rows:" << zeros << (sparse == SparseMode::Sparse ? ", loading sparse data" : ", loading dense data");
+		}
+
+		result.numerical_data = parsed_data(storage, reader.transform() != CSVReader::TRANSFORM::NONE);
+		if (sparse == SparseMode::Sparse)
+		{
+			if (!reader.get_sparse_data(transposed, result.column_header, result.row_header, parent_labels, dimension_labels, result.sparse_data))
+				return false;
+		}
+		else
+		{
+			// the numbers are parsed straight into the type they are stored in
+			std::visit([&](auto& numerical_data)
+			{
+				using T = typename std::decay_t<decltype(numerical_data)>::value_type;
+				numerical_data = reader.get_data<T>(transposed, result.column_header, result.row_header, parent_labels, dimension_labels);
+			}, result.numerical_data);
+
+			if (std::visit([](const auto& numerical_data) { return numerical_data.empty(); }, result.numerical_data))
+				return false;
+		}
+
+		result.types.assign(result.column_header.size(), ColumnType::Numerical);
+		result.numerical_columns.resize(result.column_header.size());
+		std::iota(result.numerical_columns.begin(), result.numerical_columns.end(), std::size_t(0));
+		result.categorical.resize(result.column_header.size());
+		return true;
+	}
+
+	bool is_sparse(const TypedColumns& columns)
+	{
+		return !columns.sparse_data.offsets.empty();
+	}
+
+	void densify(TypedColumns& columns)
+	{
+		if (!is_sparse(columns))
+			return;
+
+		const SparseRows& sparse = columns.sparse_data;
+		const std::size_t nrOfRows = sparse.offsets.size() - 1;
+		const std::size_t nrOfNumericalColumns = columns.numerical_columns.size();
+		std::visit([&](auto& numerical_data)
+		{
+			using T = typename std::decay_t<decltype(numerical_data)>::value_type;
+			numerical_data.resize(nrOfRows * nrOfNumericalColumns);
+			T* values = numerical_data.data();
+
+			// quantized sparse values are codes already, the cells that are left out get the code of zero of their column
+			std::vector<T> zero_row;
+			if (!columns.quantization_scale.empty())
+			{
+				zero_row.resize(nrOfNumericalColumns);
+				for (std::size_t column = 0; column < nrOfNumericalColumns; ++column)
+					zero_row[column] = quantize<T>(0.0f, columns.quantization_offset[column], columns.quantization_scale[column]);
+			}
+
+			#pragma omp parallel for schedule(dynamic,256)
+			for (std::ptrdiff_t row = 0; row < std::ptrdiff_t(nrOfRows); ++row)
+			{
+				T* row_values = values + (row * nrOfNumericalColumns);
+				if (!zero_row.empty())
+					std::copy(zero_row.cbegin(), zero_row.cend(), row_values);
+				for (std::uint64_t k = sparse.offsets[row]; k < sparse.offsets[row + 1]; ++k)
+					row_values[sparse.columns[k]] = convert_value<T>(sparse.values[k]);
+			}
+		}, columns.numerical_data);
+		columns.sparse_data = SparseRows();
+	}
+
+	void finish_numerical_data(TypedColumns& columns, const NumericalStorage storage, const Normalization normalization)
+	{
+		// normalized values are fractions and the zeros of sparse data move, so they are computed on dense floats
+		if (normalization != Normalization::None)
+		{
+			if (is_sparse(columns))
+			{
+				columns.numerical_data = std::vector<float>();
+				densify(columns);
+			}
+			else if (!std::holds_alternative<std::vector<float>>(columns.numerical_data))
+			{
+				columns.numerical_data = float_values(columns.numerical_data);
+			}
+			normalize(std::get<std::vector<float>>(columns.numerical_data), columns.numerical_columns.size(), normalization);
+		}
+
+		// floats are left when the storage depends on all values or when the numbers are transformed or normalized
+		const bool sparse = is_sparse(columns);
+		std::vector<float>* values = sparse ? &columns.sparse_data.values : std::get_if<std::vector<float>>(&columns.numerical_data);
+		if (values != nullptr && storage == NumericalStorage::Integral)
+		{
+			double lowest = 0;
+			double highest = 0;
+			if (integral_range(*values, lowest, highest))
+				convert_values(columns, *values, sparse, integral_data(lowest, highest));
+		}
+		else if (values != nullptr && (storage == NumericalStorage::ScaledUInt8 || storage == NumericalStorage::ScaledUInt16))
+		{
+			NumericalData data = (storage == NumericalStorage::ScaledUInt8) ? NumericalData(std::vector<std::uint8_t>()) : NumericalData(std::vector<std::uint16_t>());
+			const std::size_t nrOfNumericalColumns = columns.numerical_columns.size();
+			std::visit([&](auto& codes)
+			{
+				using T = typename std::decay_t<decltype(codes)>::value_type;
+				if constexpr (std::is_same_v<T, std::uint8_t> || std::is_same_v<T, std::uint16_t>)
+				{
+					// the cells that sparse data leaves out are zeros, so zero is part of the range of every column
+					const std::vector<std::uint32_t>* value_columns = sparse ? &columns.sparse_data.columns : nullptr;
+					quantization_ranges(*values, value_columns, nrOfNumericalColumns, float(std::numeric_limits<T>::max()), sparse, columns);
+					const float* offset = columns.quantization_offset.data();
+					const float* scale = columns.quantization_scale.data();
+					if (sparse)
+					{
+						#pragma omp parallel for schedule(static)
+						for (std::ptrdiff_t k = 0; k < std::ptrdiff_t(values->size()); ++k)
+						{
+							const std::uint32_t column = (*value_columns)[k];
+							(*values)[k] = float(quantize<T>((*values)[k], offset[column], scale[column]));
+						}
+						columns.numerical_data = std::move(codes);
+					}
+					else
+					{
+						codes.resize(values->size());
+						#pragma omp parallel for schedule(static)
+						for (std::ptrdiff_t i = 0; i < std::ptrdiff_t(codes.size()); ++i)
+						{
+							const std::size_t column = std::size_t(i) % nrOfNumericalColumns;
+							codes[i] = quantize<T>((*values)[i], offset[column], scale[column]);
+						}
+						columns.numerical_data = std::move(codes);
+					}
+				}
+			}, data);
+		}
+		else if (values != nullptr)
+		{
+			convert_values(columns, *values, sparse, stored_data(storage));
+		}
+		densify(columns);
+	}
+
+	bool same_columns(const TypedColumns& a, const TypedColumns& b)
+	{
+		return (a.column_header == b.column_header) && (a.types == b.types) && (a.numerical_data.index() == b.numerical_data.index());
+	}
+
+	bool concatenate_rows(std::vector<TypedColumns>& parts, TypedColumns& result)
+	{
+		if (parts.empty())
+			return false;
+
+		const TypedColumns& first = parts.front();
+		for (const TypedColumns& part : parts)
+		{
+			if (!same_columns(part, first))
+				return false;
+		}
+
+		// sparse data can only be appended to sparse data
+		const bool sparse = std::all_of(parts.cbegin(), parts.cend(), is_sparse);
+		if (!sparse)
+		{
+			for (TypedColumns& part : parts)
+				densify(part);
+		}
+
+		TypedColumns combined;
+		combined.column_header = first.column_header;
+		combined.types = first.types;
+		combined.numerical_columns = first.numerical_columns;
+		combined.numerical_data = std::move(parts.front().numerical_data);
+		std::visit([&parts](auto& numerical_data)
+		{
+			using Data = std::decay_t<decltype(numerical_data)>;
+			std::size_t size = 0;
+			for (const TypedColumns& part : parts)
+				size += std::get<Data>(part.numerical_data).size();
+			numerical_data.reserve(size);
+			for (std::size_t p = 1; p < parts.size(); ++p)
+			{
+				Data& part_data = std::get<Data>(parts[p].numerical_data);
+				numerical_data.insert(numerical_data.end(), part_data.cbegin(), part_data.cend());
+				Data().swap(part_data);
+			}
+		}, combined.numerical_data);
+		if (sparse)
+		{
+			SparseRows& sparse_data = combined.sparse_data;
+			sparse_data = std::move(parts.front().sparse_data);
+			for (std::size_t p = 1; p < parts.size(); ++p)
+			{
+				SparseRows& part_data = parts[p].sparse_data;
+				const std::uint64_t shift = sparse_data.values.size();
+				std::transform(part_data.offsets.cbegin() + 1, part_data.offsets.cend(), std::back_inserter(sparse_data.offsets), [shift](std::uint64_t offset) { return offset + shift; });
+				sparse_data.columns.insert(sparse_data.columns.end(), part_data.columns.cbegin(), part_data.columns.cend());
+				sparse_data.values.insert(sparse_data.values.end(), part_data.values.cbegin(), part_data.values.cend());
+				part_data = SparseRows();
+			}
+		}
+
+		for (TypedColumns& part : parts)
+		{
+			combined.row_header.append(part.row_header);
+			part.row_header.clear();
+		}
+		const std::size_t nrOfRows = combined.row_header.size();
+
+		// the values of every part are sorted, so the combined values are their sorted union
+		const std::size_t nrOfColumns = combined.column_header.size();
+		combined.categorical.resize(nrOfColumns);
+		#pragma omp parallel for schedule(dynamic,1)
+		for (std::ptrdiff_t column = 0; column < std::ptrdiff_t(nrOfColumns); ++column)
+		{
+			if (combined.types[column] != ColumnType::Categorical && combined.types[column] != ColumnType::Color)
+				continue;
+
+			CategoricalColumn& result_column = combined.categorical[column];
+			for (const TypedColumns& part : parts)
+			{
+				const std::vector<std::string>& values = part.categorical[column].values;
+				std::vector<std::string> merged;
+				merged.reserve(result_column.values.size() + values.size());
+				std::set_union(std::make_move_iterator(result_column.values.begin()), std::make_move_iterator(result_column.values.end()), values.cbegin(), values.cend(), std::back_inserter(merged));
+				result_column.values = std::move(merged);
+			}
+
+			result_column.codes.reserve(nrOfRows);
+			for (TypedColumns& part : parts)
+			{
+				CategoricalColumn& part_column = part.categorical[column];
+				std::vector<std::uint32_t> new_code(part_column.values.size());
+				for (std::size_t code = 0; code < new_code.size(); ++code)
+					new_code[code] = std::uint32_t(std::lower_bound(result_column.values.cbegin(), result_column.values.cend(), part_column.values[code]) - result_column.values.cbegin());
+				for (const std::uint32_t code : part_column.codes)
+					result_column.codes.push_back(new_code[code]);
+				part_column = CategoricalColumn();
+			}
+		}
+
+		parts.clear();
+		result = std::move(combined);
+		return true;
+	}
+
+	bool load_typed_columns(CSVReader& reader, bool transposed, const std::vector<std::string>& parent_labels, const std::vector<std::string>& dimension_labels, bool autodetect, bool sample_types, NumericalStorage storage, TypedColumns& result)
+	{
+		result = TypedColumns();
+		LoadStats& stats = reader.stats();
+
+		// first pass: tell the numerical columns from the others, on an evenly spread sample of the rows when asked for.
+		// a transposed file has its columns on the lines, so all of them are needed. Without autodetect every column is
+		// categorical and the file is not visited, the color columns are found among the distinct values later on
+		auto start = std::chrono::steady_clock::now();
+		const bool sampled = sample_types && autodetect && !transposed && (reader.rows() > 2 * TypeSampleRows);
+		const std::size_t row_step = sampled ? (reader.rows() / TypeSampleRows) : 1;
+		if (autodetect)
+		{
+			result.types = detect_types(reader, transposed, result.column_header, result.row_header, parent_labels, dimension_labels, autodetect, false, row_step);
+		}
+		else
+		{
+			reader.select_labels(transposed, result.column_header, result.row_header, parent_labels, dimension_labels);
+			result.types.assign(result.column_header.size(), ColumnType::Categorical);
+		}
+		stats.type_detection_seconds += seconds_since(start);
+
+		const std::size_t nrOfColumns = result.column_header.size();
+		const std::size_t nrOfRows = result.row_header.size();
+		if (nrOfColumns == 0 || nrOfRows == 0 || reader.cancelled())
+			return false;
+
+		std::vector<std::ptrdiff_t> numerical_index(nrOfColumns, -1);
+		std::vector<std::ptrdiff_t> categorical_index(nrOfColumns, -1);
+		std::size_t nrOfCategoricalColumns = 0;
+		result.categorical.resize(nrOfColumns);
+		for (std::size_t column = 0; column < nrOfColumns; ++column)
+		{
+			if (result.types[column] == ColumnType::Numerical)
+			{
+				numerical_index[column] = result.numerical_columns.size();
+				result.numerical_columns.push_back(column);
+			}
+			else
+			{
+				categorical_index[column] = nrOfCategoricalColumns++;
+				result.categorical[column].codes.assign(nrOfRows, MissingCell);
+			}
+		}
+
+		// second pass: numbers go straight into the numerical data, categorical cells are interned into a dictionary per
+		// thread and column. A line is done by a single thread, which is remembered to tell the dictionary its codes are from
+		start = std::chrono::steady_clock::now();
+		const std::size_t nrOfNumericalColumns = result.numerical_columns.size();
+		const std::size_t nrOfThreads = omp_get_max_threads();
+		std::vector<StringDictionary> dictionaries(nrOfThreads * nrOfCategoricalColumns);
+		std::vector<std::uint32_t> line_thread(transposed ? nrOfColumns : nrOfRows, 0);
+
+		const bool transformed = reader.transform() != CSVReader::TRANSFORM::NONE;
+		result.numerical_data = parsed_data(storage, transformed);
+		// A row is transformed like get_data does it, once its numbers are parsed and while they are still in cache. A row
+		// is done by a single thread, so all its numbers are parsed once the thread gets to the numbers of its next row
+		std::vector<ParsingRow> parsing_rows(transformed ? nrOfThreads : 0);
+
+		// a sampled numerical column that turns out to hold something else is noticed while parsing it
+		const NumericPolicy& policy = reader.numeric_policy();
+		std::atomic<bool> wrong_type = false;
+		std::visit([&](auto& numerical_data)
+		{
+			numerical_data.resize(nrOfRows * nrOfNumericalColumns);
+			reader.note_allocation((numerical_data.size() * sizeof(numerical_data[0])) + (nrOfRows * nrOfCategoricalColumns * sizeof(std::uint32_t)));
+			auto* values = numerical_data.data();
+			reader.for_each_cell("Parsing", transposed, result.column_header, result.row_header, parent_labels, dimension_labels, [&](std::size_t row, std::size_t column, std::string_view item)
+			{
+				const std::ptrdiff_t index = numerical_index[column];
+				if (index >= 0)
+				{
+					auto* row_values = values + (row * nrOfNumericalColumns);
+					if (parse_number(item, row_values[index], policy) == ParseResult::Invalid && sampled && !is_number(item))
+						wrong_type.store(true, std::memory_order_relaxed);
+					if constexpr (std::is_same_v<std::decay_t<decltype(*row_values)>, float>)
+					{
+						// a line of a transposed file is a column of the result, its numbers are not next to each other
+						if (transformed && transposed)
+						{
+							reader.transform_values(row_values + index, 1);
+						}
+						else if (transformed)
+						{
+							std::ptrdiff_t& parsing_row = parsing_rows[omp_get_thread_num()].row;
+							if (parsing_row != std::ptrdiff_t(row))
+							{
+								if (parsing_row >= 0)
+									reader.transform_values(values + (parsing_row * nrOfNumericalColumns), nrOfNumericalColumns);
+								parsing_row = std::ptrdiff_t(row);
+							}
+						}
+					}
+				}
+				else
+				{
+					const std::size_t thread = omp_get_thread_num();
+					line_thread[transposed ? column : row] = std::uint32_t(thread);
+					result.categorical[column].codes[row] = dictionaries[(thread * nrOfCategoricalColumns) + categorical_index[column]].intern(item);
+				}
+			});
+
+			// the last row of every thread
+			if constexpr (std::is_same_v<std::decay_t<decltype(*values)>, float>)
+			{
+				for (const ParsingRow& parsing_row : parsing_rows)
+					if (parsing_row.row >= 0)
+						reader.transform_values(values + (parsing_row.row * nrOfNumericalColumns), nrOfNumericalColumns);
+			}
+		}, result.numerical_data);
+		if (reader.cancelled())
+		{
+			result = TypedColumns();
+			return false;
+		}
+		if (wrong_type)
+		{
+			qDebug() << "The types detected on a sample of the rows do not hold, detecting them on all rows";
+			return load_typed_columns(reader, transposed, parent_labels, dimension_labels, autodetect, false, storage, result);
+		}
+
+		// third pass: merge the dictionaries of the threads, a column is a color column when all its distinct values are colors
+		#pragma omp parallel for schedule(dynamic,1)
+		for (std::ptrdiff_t column = 0; column < std::ptrdiff_t(nrOfColumns); ++column)
+		{
+			const std::ptrdiff_t index = categorical_index[column];
+			if (index >= 0 && merge_dictionaries(dictionaries.data() + index, nrOfCategoricalColumns, nrOfThreads, line_thread, transposed, column, result.categorical[column]))
+				result.types[column] = ColumnType::Color;
+		}
+		stats.parse_seconds += seconds_since(start);
+
+		qDebug() << nrOfColumns << " x " << nrOfRows << " typed columns loaded, " << nrOfNumericalColumns << " numerical";
+		return true;
+	}
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "csvreader.h"
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include <biovault_bfloat16/biovault_bfloat16.h>
+
+namespace ExtCsvLoader
+{
+	enum class ColumnType : std::uint8_t { Unknown, Numerical, Categorical, Color };
+
+	// Integral is the smallest integer type that holds all values exactly, or Float when they are not all integers.
+	// ScaledUInt8 and ScaledUInt16 map the range of every column linearly onto the range of the type.
+	enum class NumericalStorage { Float, BFloat16, Int8, UInt8, Int16, UInt16, Int32, ScaledUInt8, ScaledUInt16, Integral };
+
+	using NumericalData = std::variant<std::vector<float>, std::vector<biovault::bfloat16_t>, std::vector<std::int8_t>, std::vector<std::uint8_t>, std::vector<std::int16_t>, std::vector<std::uint16_t>, std::vector<std::int32_t>>;
+
+	// Auto loads numerical columns as sparse data when they are mostly zeros
+	enum class SparseMode { Dense, Auto, Sparse };
+
+	// per numerical column: ZScore gives mean 0 and standard deviation 1, MinMax maps the range onto [0, 1]
+	enum class Normalization { None, ZScore, MinMax };
+
+	// the distinct values of a column in sorted order, every cell is stored as the index (code) of its value
+	struct CategoricalColumn
+	{
+		std::vector<std::string> values;
+		std::vector<std::uint32_t> codes;
+	};
+
+	// the rows of every value of a categorical column, grouped by value and sorted within a value
+	struct ClusterIndices
+	{
+		std::vector<std::uint32_t> offsets;	// the rows of value v are rows[offsets[v]] up to rows[offsets[v + 1]]
+		std::vector<std::uint32_t> rows;
+
+		std::size_t size() const;
+		std::span<const std::uint32_t> operator[](const std::size_t value) const;
+	};
+
+	// counting sort of the codes of a column, linear in the number of rows
+	ClusterIndices cluster_indices(const CategoricalColumn& column);
+
+	// hash of the way a column partitions the rows, independent of the values themselves:
+	// columns that group the rows in the same way have the same signature
+	std::uint64_t partition_signature(const CategoricalColumn& column);
+
+	// true when both columns group the rows in exactly the same way, value_map then maps every value of a to the matching value of b
+	bool same_partition(const CategoricalColumn& a, const CategoricalColumn& b, std::vector<std::uint32_t>& value_map);
+
+	struct TypedColumns
+	{
+		Labels column_header;
+		Labels row_header;
+		std::vector<ColumnType> types;
+
+		// the numerical columns, row major with numerical_columns.size() values per row
+		std::vector<std::size_t> numerical_columns;
+		NumericalData numerical_data;
+
+		// one entry per column, only filled for categorical and color columns
+		std::vector<CategoricalColumn> categorical;
+
+		// the numerical columns of a sparse load, numerical_data then stays empty (but tells the storage) until densify
+		SparseRows sparse_data;
+
+		// only with scaled storage: value = quantization_offset[i] + quantization_scale[i] * stored value, for numerical column i
+		std::vector<float> quantization_offset;
+		std::vector<float> quantization_scale;
+	};
+
+	bool is_sparse(const TypedColumns& columns);
+
+	// Turns sparse numerical data into the row major numerical_data the dataset is created from, rows are filled in parallel
+	// and the sparse data is released afterwards. Does nothing for dense data.
+	void densify(TypedColumns& columns);
+
+	// Builds the numerical data the dataset is created from: the columns are normalized in place, the storages that depend on
+	// all values (Integral, ScaledUInt8 and ScaledUInt16) are applied to the parsed floats, then sparse data is densified straight
+	// into the final type. The other storages are parsed into their own type directly unless the reader transforms the numbers,
+	// which is done on floats. Normalized data is dense, as the zeros of sparse data do not stay zero.
+	void finish_numerical_data(TypedColumns& columns, NumericalStorage storage, Normalization normalization = Normalization::None);
+
+	// true when both have the same columns of the same types and the same numerical storage
+	bool same_columns(const TypedColumns& a, const TypedColumns& b);
+
+	// Appends the rows of all parts to result, parts are emptied. All parts need the same columns (see same_columns),
+	// false (and result untouched) when they differ. The values of a categorical column are the union of
+	// the values of that column in all parts. The result is only sparse when all parts are.
+	bool concatenate_rows(std::vector<TypedColumns>& parts, TypedColumns& result);
+
+	// Loads every selected column as a numerical column, cells that are not a number are converted with the numeric policy of the reader.
+	// Sparse data is built while parsing, with SparseMode::Auto when zeros are common enough in the first rows that it takes at most
+	// half the memory of the dense data.
+	bool load_numerical_columns(CSVReader& reader, bool transposed, const std::vector<std::string>& parent_labels, const std::vector<std::string>& dimension_labels, NumericalStorage storage, SparseMode sparse, TypedColumns& result);
+
+	// The type of every column of the rows the reader has read, as load_typed_columns would detect it.
+	// After reading a sample of the rows these are hints: a later row can still turn a numerical column into a categorical one.
+	std::vector<ColumnType> detect_column_types(CSVReader& reader, bool autodetect);
+
+	// Loads every selected column with its own type. With autodetect a column that holds only numbers is numerical,
+	// otherwise a column is a color column when all its values are color names and categorical when they are not.
+	// No string is created per cell: the numbers are recognized on the items of the CsvBuffers, numbers are parsed into
+	// numerical_data directly and categorical cells are interned into a hash based dictionary per column and thread, which
+	// are merged afterwards. Colors are checked once per distinct value of a column. With sample_types the numerical columns are detected on about a
+	// thousand rows spread over the file and verified while parsing, the types are detected on all rows when that fails.
+	bool load_typed_columns(CSVReader& reader, bool transposed, const std::vector<std::string>& parent_labels, const std::vector<std::string>& dimension_labels, bool autodetect, bool sample_types, NumericalStorage storage, TypedColumns& result);
+}
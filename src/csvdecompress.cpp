@@ -0,0 +1,376 @@
+#include "csvdecompress.h"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#ifdef EXTCSVLOADER_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef EXTCSVLOADER_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace ExtCsvLoader
+{
+	namespace
+	{
+		// the text grows by this much at a time while streaming
+		constexpr std::size_t chunk_size = std::size_t(1) << 22;
+
+		// an independently compressed part of a file and where its data goes in the text
+		struct Part
+		{
+			std::size_t in_offset;
+			std::size_t in_size;
+			std::size_t out_offset;
+			std::size_t out_size;
+		};
+
+		std::uint32_t read_le16(const unsigned char* p)
+		{
+			return std::uint32_t(p[0]) | (std::uint32_t(p[1]) << 8);
+		}
+
+		std::uint32_t read_le32(const unsigned char* p)
+		{
+			return read_le16(p) | (read_le16(p + 2) << 16);
+		}
+
+#if defined(EXTCSVLOADER_WITH_ZLIB) || defined(EXTCSVLOADER_WITH_ZSTD)
+		// The size of the next part of a stream that is decompressed into text. A text that is reserved for the size
+		// the stream is expected to have is filled up to its capacity first, so it is not reallocated while it grows.
+		std::size_t next_chunk_size(const std::string& text, const std::size_t reserved)
+		{
+			return (text.size() < reserved) ? std::min(chunk_size, reserved - text.size()) : chunk_size;
+		}
+
+		// the text is reserved a byte larger than size_hint, so the end of a stream of that size fits and is noticed
+		std::size_t reserve_text(std::string& text, const std::size_t size_hint)
+		{
+			if (size_hint == 0)
+				return 0;
+			text.reserve(size_hint + 1);
+			return text.capacity();
+		}
+#endif
+
+#ifdef EXTCSVLOADER_WITH_ZLIB
+		// A BGZF file is a series of gzip members of at most 64KB, each with its size in a "BC" extra field and its
+		// uncompressed size in its trailer, so every block can be inflated on its own. False for any other gzip file.
+		bool bgzf_blocks(std::string_view data, std::vector<Part>& blocks)
+		{
+			blocks.clear();
+			std::size_t pos = 0;
+			std::size_t out = 0;
+			while (pos < data.size())
+			{
+				const std::size_t remaining = data.size() - pos;
+				const auto* p = reinterpret_cast<const unsigned char*>(data.data() + pos);
+				if (remaining < 18 || p[0] != 0x1f || p[1] != 0x8b || p[2] != 8 || !(p[3] & 4))
+					return false;
+
+				const std::size_t xlen = read_le16(p + 10);
+				if (12 + xlen + 8 > remaining)
+					return false;
+				std::size_t block_size = 0;
+				for (std::size_t x = 12; x + 4 <= 12 + xlen;)
+				{
+					const std::size_t slen = read_le16(p + x + 2);
+					if (p[x] == 'B' && p[x + 1] == 'C' && slen == 2 && x + 6 <= 12 + xlen)
+						block_size = read_le16(p + x + 4) + 1;
+					x += 4 + slen;
+				}
+				if (block_size < 12 + xlen + 8 || block_size > remaining)
+					return false;
+
+				const std::size_t isize = read_le32(p + block_size - 4);
+				if (isize > 65536)
+					return false;
+				blocks.push_back({ pos + 12 + xlen, block_size - 12 - xlen - 8, out, isize });
+				out += isize;
+				pos += block_size;
+			}
+			return blocks.size() > 1;
+		}
+
+		bool inflate_blocks(std::string_view data, const std::vector<Part>& blocks, std::string& text)
+		{
+			text.resize(blocks.back().out_offset + blocks.back().out_size);
+			bool ok = true;
+			#pragma omp parallel
+			{
+				z_stream stream = {};
+				bool thread_ok = (inflateInit2(&stream, -15) == Z_OK);
+				#pragma omp for schedule(dynamic,16)
+				for (std::ptrdiff_t b = 0; b < std::ptrdiff_t(blocks.size()); ++b)
+				{
+					const Part& block = blocks[b];
+					if (!thread_ok || block.out_size == 0)
+						continue;
+
+					inflateReset(&stream);
+					stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data() + block.in_offset));
+					stream.avail_in = uInt(block.in_size);
+					stream.next_out = reinterpret_cast<Bytef*>(text.data() + block.out_offset);
+					stream.avail_out = uInt(block.out_size);
+					const auto* trailer = reinterpret_cast<const unsigned char*>(data.data() + block.in_offset + block.in_size);
+					thread_ok = (inflate(&stream, Z_FINISH) == Z_STREAM_END) && (stream.avail_out == 0)
+						&& (crc32(0, reinterpret_cast<const Bytef*>(text.data() + block.out_offset), uInt(block.out_size)) == read_le32(trailer));
+				}
+				inflateEnd(&stream);
+				if (!thread_ok)
+				{
+					#pragma omp atomic write
+					ok = false;
+				}
+			}
+			return ok;
+		}
+
+		// inflates a gzip file of one or more members, or a zlib stream
+		// The uncompressed size of a gzip file, from the trailer of its last member. That holds the size modulo 4GB and only
+		// of the last member, so for an intact file it is never more than the size of the text, and it is exact for a single
+		// member below 4GB. Deflate compresses at most about 1032 to 1, a larger size comes from a damaged file.
+		std::size_t gzip_size_hint(std::string_view data)
+		{
+			if (data.size() < 18)
+				return 0;
+			const std::size_t size = read_le32(reinterpret_cast<const unsigned char*>(data.data() + data.size() - 4));
+			return (size / 1032 <= data.size()) ? size : 0;
+		}
+
+		bool inflate_stream(std::string_view data, std::string& text, bool& complete, const EnoughFunction& enough, const std::size_t size_hint)
+		{
+			z_stream stream = {};
+			if (inflateInit2(&stream, 15 + 32) != Z_OK)
+				return false;
+
+			std::size_t in_pos = 0;
+			bool ok = true;
+			const std::size_t reserved = reserve_text(text, size_hint);
+			while (ok && !complete)
+			{
+				const std::size_t old_size = text.size();
+				const std::size_t size = next_chunk_size(text, reserved);
+				text.resize(old_size + size);
+				stream.next_out = reinterpret_cast<Bytef*>(text.data() + old_size);
+				stream.avail_out = uInt(size);
+				while (stream.avail_out > 0)
+				{
+					// zlib counts the input in 32 bits, so a large file is passed in parts
+					if (stream.avail_in == 0 && in_pos < data.size())
+					{
+						const std::size_t in_size = std::min<std::size_t>(data.size() - in_pos, std::numeric_limits<uInt>::max());
+						stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data() + in_pos));
+						stream.avail_in = uInt(in_size);
+						in_pos += in_size;
+					}
+
+					const int status = inflate(&stream, Z_NO_FLUSH);
+					if (status == Z_STREAM_END)
+					{
+						// a gzip file can consist of several members, e.g. when it is compressed in parallel
+						if (stream.avail_in == 0 && in_pos == data.size())
+						{
+							complete = true;
+							break;
+						}
+						inflateReset(&stream);
+					}
+					else if (status != Z_OK)
+					{
+						// also a file that ends in the middle of a member
+						ok = false;
+						break;
+					}
+				}
+				text.resize(text.size() - stream.avail_out);
+				if (ok && enough && enough(std::string_view(text).substr(old_size)))
+					break;
+			}
+			inflateEnd(&stream);
+			return ok;
+		}
+#endif
+
+#ifdef EXTCSVLOADER_WITH_ZSTD
+		// the frames of a zstd file, false when there is only one or when the size of a frame is not known in advance
+		bool zstd_frames(std::string_view data, std::vector<Part>& frames)
+		{
+			frames.clear();
+			std::size_t pos = 0;
+			std::size_t out = 0;
+			while (pos < data.size())
+			{
+				const std::size_t frame_size = ZSTD_findFrameCompressedSize(data.data() + pos, data.size() - pos);
+				const unsigned long long content_size = ZSTD_getFrameContentSize(data.data() + pos, data.size() - pos);
+				if (ZSTD_isError(frame_size) || content_size == ZSTD_CONTENTSIZE_UNKNOWN || content_size == ZSTD_CONTENTSIZE_ERROR)
+					return false;
+				// a damaged header must not lead to a huge allocation, a block of at most 128KB takes at least 4 bytes
+				if (content_size / 32768 > frame_size)
+					return false;
+
+				frames.push_back({ pos, frame_size, out, std::size_t(content_size) });
+				out += content_size;
+				pos += frame_size;
+			}
+			return frames.size() > 1;
+		}
+
+		bool decompress_frames(std::string_view data, const std::vector<Part>& frames, std::string& text)
+		{
+			text.resize(frames.back().out_offset + frames.back().out_size);
+			bool ok = true;
+			#pragma omp parallel
+			{
+				ZSTD_DCtx* context = ZSTD_createDCtx();
+				bool thread_ok = (context != nullptr);
+				#pragma omp for schedule(dynamic,1)
+				for (std::ptrdiff_t f = 0; f < std::ptrdiff_t(frames.size()); ++f)
+				{
+					const Part& frame = frames[f];
+					if (thread_ok)
+						thread_ok = (ZSTD_decompressDCtx(context, text.data() + frame.out_offset, frame.out_size, data.data() + frame.in_offset, frame.in_size) == frame.out_size);
+				}
+				ZSTD_freeDCtx(context);
+				if (!thread_ok)
+				{
+					#pragma omp atomic write
+					ok = false;
+				}
+			}
+			return ok;
+		}
+
+		// the size of the first frame of a zstd file when its header holds it, which is the size of the text for a single frame
+		std::size_t zstd_size_hint(std::string_view data)
+		{
+			const unsigned long long content_size = ZSTD_getFrameContentSize(data.data(), data.size());
+			if (content_size == ZSTD_CONTENTSIZE_UNKNOWN || content_size == ZSTD_CONTENTSIZE_ERROR)
+				return 0;
+			// a damaged header must not lead to a huge allocation, as in zstd_frames
+			if (content_size / 32768 > data.size())
+				return 0;
+			return std::size_t(content_size);
+		}
+
+		bool decompress_stream(std::string_view data, std::string& text, bool& complete, const EnoughFunction& enough, const std::size_t size_hint)
+		{
+			ZSTD_DStream* stream = ZSTD_createDStream();
+			if (stream == nullptr)
+				return false;
+
+			ZSTD_inBuffer input = { data.data(), data.size(), 0 };
+			bool ok = true;
+			const std::size_t reserved = reserve_text(text, size_hint);
+			while (ok && !complete)
+			{
+				const std::size_t old_size = text.size();
+				const std::size_t size = next_chunk_size(text, reserved);
+				text.resize(old_size + size);
+				ZSTD_outBuffer output = { text.data() + old_size, size, 0 };
+				while (output.pos < output.size)
+				{
+					const std::size_t result = ZSTD_decompressStream(stream, &output, &input);
+					if (ZSTD_isError(result))
+					{
+						ok = false;
+						break;
+					}
+					if (input.pos == input.size && output.pos < output.size)
+					{
+						// everything is decompressed, unless the file ends in the middle of a frame
+						complete = (result == 0);
+						ok = complete;
+						break;
+					}
+				}
+				text.resize(old_size + output.pos);
+				if (ok && enough && enough(std::string_view(text).substr(old_size)))
+					break;
+			}
+			ZSTD_freeDStream(stream);
+			return ok;
+		}
+#endif
+	}
+
+	Compression detect_compression(std::string_view data)
+	{
+		if (data.size() >= 2 && std::uint8_t(data[0]) == 0x1f && std::uint8_t(data[1]) == 0x8b)
+			return Compression::Gzip;
+		if (data.size() >= 4 && read_le32(reinterpret_cast<const unsigned char*>(data.data())) == 0xfd2fb528)
+			return Compression::Zstd;
+		return Compression::None;
+	}
+
+	const char* compression_name(const Compression compression)
+	{
+		switch (compression)
+		{
+		case Compression::Gzip:
+			return "gzip";
+		case Compression::Zstd:
+			return "zstd";
+		default:
+			return "none";
+		}
+	}
+
+	bool compression_supported(const Compression compression)
+	{
+		switch (compression)
+		{
+		case Compression::None:
+			return true;
+#ifdef EXTCSVLOADER_WITH_ZLIB
+		case Compression::Gzip:
+			return true;
+#endif
+#ifdef EXTCSVLOADER_WITH_ZSTD
+		case Compression::Zstd:
+			return true;
+#endif
+		default:
+			return false;
+		}
+	}
+
+	bool decompress([[maybe_unused]] std::string_view data, Compression compression, std::string& text, bool& complete, const EnoughFunction& enough)
+	{
+		text.clear();
+		complete = false;
+		[[maybe_unused]] const bool whole_file = !enough;
+		[[maybe_unused]] std::vector<Part> parts;
+		bool ok = false;
+		switch (compression)
+		{
+#ifdef EXTCSVLOADER_WITH_ZLIB
+		case Compression::Gzip:
+			if (whole_file && bgzf_blocks(data, parts))
+				ok = complete = inflate_blocks(data, parts, text);
+			else
+				ok = inflate_stream(data, text, complete, enough, whole_file ? gzip_size_hint(data) : 0);
+			break;
+#endif
+#ifdef EXTCSVLOADER_WITH_ZSTD
+		case Compression::Zstd:
+			if (whole_file && zstd_frames(data, parts))
+				ok = complete = decompress_frames(data, parts, text);
+			else
+				ok = decompress_stream(data, text, complete, enough, whole_file ? zstd_size_hint(data) : 0);
+			break;
+#endif
+		default:
+			break;
+		}
+		if (!ok)
+			text.clear();
+		return ok;
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace ExtCsvLoader
+{
+	enum class Compression { None, Gzip, Zstd };
+
+	// the compression of a file, detected from its first bytes
+	Compression detect_compression(std::string_view data);
+	const char* compression_name(Compression compression);
+
+	// false when the plugin is built without the library for the compression
+	bool compression_supported(Compression compression);
+
+	// tells whether the text decompressed so far is enough, it is called with the text added since the previous call
+	using EnoughFunction = std::function<bool(std::string_view added_text)>;
+
+	// Decompresses data into text, or only its start when enough is given: the stream is decompressed a few MB at a time
+	// until enough returns true, so reading the header of a large file only decompresses the start of it, once. complete
+	// tells whether all data is decompressed. When the whole file is decompressed, independent parts of it (the blocks of
+	// a BGZF file, the frames of a zstd file) are decompressed in parallel. False when the data is damaged or the
+	// compression is not supported.
+	bool decompress(std::string_view data, Compression compression, std::string& text, bool& complete, const EnoughFunction& enough = {});
+}
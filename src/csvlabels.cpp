@@ -0,0 +1,159 @@
+#include "csvlabels.h"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace ExtCsvLoader
+{
+	namespace
+	{
+		// the offsets are summed up first, then every label is copied to its place in parallel
+		template <typename Label>
+		void copy_labels(const std::vector<Label>& labels, std::string& text, std::vector<std::uint64_t>& offsets)
+		{
+			offsets.resize(labels.size() + 1);
+			offsets[0] = 0;
+			for (std::size_t i = 0; i < labels.size(); ++i)
+				offsets[i + 1] = offsets[i] + labels[i].size();
+
+			text.resize(offsets.back());
+			char* chars = text.data();
+			#pragma omp parallel for schedule(static)
+			for (std::ptrdiff_t i = 0; i < std::ptrdiff_t(labels.size()); ++i)
+			{
+				if (!labels[i].empty())
+					std::memcpy(chars + offsets[i], labels[i].data(), labels[i].size());
+			}
+		}
+	}
+
+	Labels::Labels(const std::vector<std::string_view>& labels)
+	{
+		Storage& storage = modify();
+		copy_labels(labels, storage.text, storage.offsets);
+	}
+
+	Labels::Labels(const std::vector<std::string>& labels)
+	{
+		Storage& storage = modify();
+		copy_labels(labels, storage.text, storage.offsets);
+	}
+
+	Labels::Storage& Labels::modify()
+	{
+		// a use count of one can not go up behind our back, only a copy of these labels could share them
+		if (!m_storage)
+			m_storage = std::make_shared<Storage>();
+		else if (m_storage.use_count() > 1)
+			m_storage = std::make_shared<Storage>(*m_storage);
+		return *m_storage;
+	}
+
+	bool Labels::assign(std::string&& text, std::vector<std::uint64_t>&& offsets)
+	{
+		clear();
+		if (offsets.empty() || offsets.front() != 0 || offsets.back() != text.size() || !std::is_sorted(offsets.cbegin(), offsets.cend()))
+			return false;
+		Storage& storage = modify();
+		storage.text = std::move(text);
+		storage.offsets = std::move(offsets);
+		return true;
+	}
+
+	std::size_t Labels::size() const
+	{
+		return (!m_storage || m_storage->offsets.empty()) ? 0 : m_storage->offsets.size() - 1;
+	}
+
+	bool Labels::empty() const
+	{
+		return size() == 0;
+	}
+
+	std::string_view Labels::operator[](const std::size_t index) const
+	{
+		const std::vector<std::uint64_t>& offsets = m_storage->offsets;
+		return std::string_view(m_storage->text.data() + offsets[index], offsets[index + 1] - offsets[index]);
+	}
+
+	Labels::const_iterator Labels::begin() const
+	{
+		return const_iterator(this, 0);
+	}
+
+	Labels::const_iterator Labels::end() const
+	{
+		return const_iterator(this, size());
+	}
+
+	const std::string& Labels::text() const
+	{
+		static const std::string no_text;
+		return m_storage ? m_storage->text : no_text;
+	}
+
+	const std::vector<std::uint64_t>& Labels::offsets() const
+	{
+		static const std::vector<std::uint64_t> no_offsets;
+		return m_storage ? m_storage->offsets : no_offsets;
+	}
+
+	void Labels::push_back(std::string_view label)
+	{
+		Storage& storage = modify();
+		if (storage.offsets.empty())
+			storage.offsets.push_back(0);
+		storage.text.append(label);
+		storage.offsets.push_back(storage.text.size());
+	}
+
+	void Labels::append(const Labels& other)
+	{
+		if (other.empty())
+			return;
+		if (empty())
+		{
+			m_storage = other.m_storage;
+			return;
+		}
+
+		// other can share the storage of these labels, so it is kept alive until it is appended
+		const std::shared_ptr<Storage> appended = other.m_storage;
+		Storage& storage = modify();
+		const std::uint64_t shift = storage.text.size();
+		storage.text.append(appended->text);
+		storage.offsets.reserve(storage.offsets.size() + appended->offsets.size() - 1);
+		for (std::size_t i = 1; i < appended->offsets.size(); ++i)
+			storage.offsets.push_back(shift + appended->offsets[i]);
+	}
+
+	void Labels::clear()
+	{
+		m_storage.reset();
+	}
+
+	std::vector<std::string> Labels::strings() const
+	{
+		std::vector<std::string> result(size());
+		#pragma omp parallel for schedule(static)
+		for (std::ptrdiff_t i = 0; i < std::ptrdiff_t(result.size()); ++i)
+			result[i] = (*this)[i];
+		return result;
+	}
+
+	bool Labels::operator==(const Labels& other) const
+	{
+		// no labels can be stored with or without the leading offset
+		if (m_storage == other.m_storage)
+			return true;
+		return (size() == other.size()) && (text() == other.text()) && (empty() || offsets() == other.offsets());
+	}
+
+	bool Labels::operator!=(const Labels& other) const
+	{
+		return !(*this == other);
+	}
+}
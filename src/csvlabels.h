@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ExtCsvLoader
+{
+	// The labels of the rows or columns of a file, stored back to back in one block of text. Millions of labels then take
+	// two allocations instead of one string each, and they are cached and moved as two arrays. Copies share the text, so
+	// handing the labels of the reader to every load costs nothing; changing shared labels copies them first. A label
+	// is a view on the text, it stays valid until the labels are changed.
+	class Labels
+	{
+		struct Storage
+		{
+			std::string text;
+			std::vector<std::uint64_t> offsets;	// label i is text[offsets[i]] up to text[offsets[i + 1]]
+		};
+		std::shared_ptr<Storage> m_storage;	// null when there are no labels
+
+		// the storage of these labels only, to change them
+		Storage& modify();
+
+	public:
+		class const_iterator
+		{
+			const Labels* m_labels = nullptr;
+			std::size_t m_index = 0;
+
+		public:
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = std::string_view;
+			using difference_type = std::ptrdiff_t;
+			using pointer = void;
+			using reference = std::string_view;
+
+			const_iterator() = default;
+			const_iterator(const Labels* labels, const std::size_t index) : m_labels(labels), m_index(index) {}
+
+			std::string_view operator*() const { return (*m_labels)[m_index]; }
+			const_iterator& operator++() { ++m_index; return *this; }
+			const_iterator operator++(int) { const_iterator result = *this; ++m_index; return result; }
+			bool operator==(const const_iterator& other) const { return m_index == other.m_index; }
+			bool operator!=(const const_iterator& other) const { return m_index != other.m_index; }
+		};
+
+		Labels() = default;
+		// the labels are copied into the text in parallel
+		explicit Labels(const std::vector<std::string_view>& labels);
+		explicit Labels(const std::vector<std::string>& labels);
+		// the text and offsets as they are cached, false (and no labels) when they do not fit together
+		bool assign(std::string&& text, std::vector<std::uint64_t>&& offsets);
+
+		std::size_t size() const;
+		bool empty() const;
+		std::string_view operator[](const std::size_t index) const;
+		const_iterator begin() const;
+		const_iterator end() const;
+
+		const std::string& text() const;
+		const std::vector<std::uint64_t>& offsets() const;
+
+		void push_back(std::string_view label);
+		// appends all labels of other
+		void append(const Labels& other);
+		void clear();
+
+		// a copy as separate strings, e.g. for the labels that are selected
+		std::vector<std::string> strings() const;
+
+		bool operator==(const Labels& other) const;
+		bool operator!=(const Labels& other) const;
+	};
+}
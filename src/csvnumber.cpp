@@ -0,0 +1,363 @@
+#include "csvnumber.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <locale>
+#include <sstream>
+#include <string>
+#include <system_error>
+
+namespace ExtCsvLoader
+{
+	namespace
+	{
+		std::string_view trim(std::string_view text)
+		{
+			while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+				text.remove_prefix(1);
+			while (!text.empty() && (text.back() == ' ' || text.back() == '\t'))
+				text.remove_suffix(1);
+			return text;
+		}
+
+		bool is_digit(const char c)
+		{
+			return c >= '0' && c <= '9';
+		}
+
+		// true when text only holds digits, tested 8 characters at a time in a 64 bit word
+		bool all_digits(std::string_view text)
+		{
+			constexpr std::uint64_t high_nibbles = 0xF0F0F0F0F0F0F0F0ull;
+			constexpr std::uint64_t zeros = 0x3030303030303030ull;	// '0' in every byte
+			constexpr std::uint64_t sixes = 0x0606060606060606ull;	// pushes '9' + 1 and above out of the 0x30 range
+			const char* p = text.data();
+			std::size_t size = text.size();
+			for (; size >= 8; p += 8, size -= 8)
+			{
+				std::uint64_t word;
+				std::memcpy(&word, p, 8);
+				if ((word & high_nibbles) != zeros || ((word + sixes) & high_nibbles) != zeros)
+					return false;
+			}
+			for (; size > 0; ++p, --size)
+			{
+				if (!is_digit(*p))
+					return false;
+			}
+			return true;
+		}
+
+		// a decimal number of the form [+-]digits[.digits][(e|E)[+-]digits] as mantissa * 10^exponent
+		struct Decimal
+		{
+			std::uint64_t mantissa = 0;
+			int exponent = 0;
+			int digits = 0;			// significant digits in the mantissa
+			bool negative = false;
+			bool truncated = false;	// more non-zero digits than fit in the mantissa
+		};
+
+		// returns false when text is not completely a decimal number (e.g. nan, inf or "1.5x")
+		bool scan_decimal(std::string_view text, Decimal& d)
+		{
+			constexpr std::uint64_t mantissa_limit = 1000000000000000000ull; // 10^18, one more digit still fits in 64 bits
+			const char* p = text.data();
+			const char* const end = p + text.size();
+
+			if (p < end && (*p == '+' || *p == '-'))
+			{
+				d.negative = (*p == '-');
+				++p;
+			}
+
+			bool any_digit = false;
+			auto add_digit = [&d](const int digit, const bool fraction)
+			{
+				if (d.mantissa < mantissa_limit)
+				{
+					d.mantissa = (d.mantissa * 10) + digit;
+					if (d.mantissa)
+						++d.digits;
+					if (fraction)
+						--d.exponent;
+				}
+				else
+				{
+					d.truncated |= (digit != 0);
+					if (!fraction)
+						++d.exponent;
+				}
+			};
+			for (; p < end && is_digit(*p); ++p, any_digit = true)
+				add_digit(*p - '0', false);
+			if (p < end && *p == '.')
+			{
+				for (++p; p < end && is_digit(*p); ++p, any_digit = true)
+					add_digit(*p - '0', true);
+			}
+			if (!any_digit)
+				return false;
+
+			if (p < end && (*p == 'e' || *p == 'E'))
+			{
+				++p;
+				bool negative_exponent = false;
+				if (p < end && (*p == '+' || *p == '-'))
+				{
+					negative_exponent = (*p == '-');
+					++p;
+				}
+				if (p == end || !is_digit(*p))
+					return false;
+				int exponent = 0;
+				for (; p < end && is_digit(*p); ++p)
+				{
+					if (exponent < 100000)
+						exponent = (exponent * 10) + (*p - '0');
+				}
+				d.exponent += negative_exponent ? -exponent : exponent;
+			}
+			return p == end;
+		}
+
+		// limits within which mantissa and power of ten are both exact, so a single multiplication or division rounds correctly
+		template <typename T>
+		struct ExactRange;
+
+		template <>
+		struct ExactRange<float>
+		{
+			static constexpr std::uint64_t max_mantissa = std::uint64_t(1) << 24;
+			static constexpr int max_exponent = 10;
+			static constexpr float powers[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+		};
+
+		template <>
+		struct ExactRange<double>
+		{
+			static constexpr std::uint64_t max_mantissa = std::uint64_t(1) << 53;
+			static constexpr int max_exponent = 22;
+			static constexpr double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+		};
+
+		template <typename T>
+		T policy_value(const NumericPolicy::Value value)
+		{
+			return (value == NumericPolicy::Value::NaN) ? std::numeric_limits<T>::quiet_NaN() : T(0);
+		}
+
+		// full precision conversion for everything outside the exact range, hexadecimal numbers included.
+		// Returns the end of the number that text starts with, begin when it does not start with a number.
+		template <typename T>
+		const char* convert(const char* begin, const char* end, T& value, bool& out_of_range)
+		{
+			out_of_range = false;
+#if defined(__cpp_lib_to_chars) || defined(_MSC_VER)
+			const bool negative = (*begin == '-');
+			const char* const digits = negative ? begin + 1 : begin;
+			if ((end - digits) > 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X'))
+			{
+				const auto [ptr, ec] = std::from_chars(digits + 2, end, value, std::chars_format::hex);
+				out_of_range = (ec == std::errc::result_out_of_range);
+				if (ec == std::errc() || out_of_range)
+				{
+					if (negative)
+						value = -value;
+					return ptr;
+				}
+				// "0x" without hexadecimal digits is the number 0 followed by an x
+			}
+			const auto [ptr, ec] = std::from_chars(begin, end, value);
+			out_of_range = (ec == std::errc::result_out_of_range);
+			return (ec == std::errc() || out_of_range) ? ptr : begin;
+#else
+			// standard libraries without floating point from_chars, the classic locale keeps this locale independent
+			std::istringstream stream(std::string(begin, end));
+			stream.imbue(std::locale::classic());
+			stream >> value;
+			if (stream.fail())
+				return begin;
+			return stream.eof() ? end : begin + std::ptrdiff_t(stream.tellg());
+#endif
+		}
+
+		template <typename T>
+		ParseResult parse_floating(std::string_view text, T& v, const NumericPolicy& policy)
+		{
+			text = trim(text);
+			if (text.empty())
+			{
+				v = policy_value<T>(policy.empty);
+				return ParseResult::Empty;
+			}
+
+			Decimal d;
+			const bool isDecimal = scan_decimal(text, d);
+			if (isDecimal)
+			{
+				if (d.mantissa == 0)
+				{
+					v = d.negative ? -T(0) : T(0);
+					return ParseResult::Number;
+				}
+				if (!d.truncated && d.mantissa <= ExactRange<T>::max_mantissa && d.exponent >= -ExactRange<T>::max_exponent && d.exponent <= ExactRange<T>::max_exponent)
+				{
+					T value = T(d.mantissa);
+					if (d.exponent < 0)
+						value /= ExactRange<T>::powers[-d.exponent];
+					else
+						value *= ExactRange<T>::powers[d.exponent];
+					v = d.negative ? -value : value;
+					return ParseResult::Number;
+				}
+			}
+
+			// from_chars does not accept a leading '+'
+			const char* begin = text.data();
+			const char* const end = begin + text.size();
+			if (*begin == '+' && (end - begin) > 1 && begin[1] != '-')
+				++begin;
+
+			T value = T(0);
+			bool out_of_range = false;
+			const char* const number_end = convert(begin, end, value, out_of_range);
+			const bool complete = (number_end == end);
+			if (number_end == begin || (!complete && !policy.number_prefix))
+			{
+				v = policy_value<T>(policy.invalid);
+				return ParseResult::Invalid;
+			}
+			if (out_of_range)
+			{
+				// overflow when the magnitude of the number is at least one, underflow otherwise
+				Decimal number;
+				const bool overflow = scan_decimal(std::string_view(begin, number_end - begin), number) && (number.exponent + number.digits) > 0;
+				value = overflow ? std::numeric_limits<T>::infinity() : T(0);
+				if (*begin == '-')
+					value = -value;
+			}
+
+			if (std::isnan(value) && !policy.allow_nan)
+			{
+				v = policy_value<T>(policy.invalid);
+				return ParseResult::Invalid;
+			}
+			if (std::isinf(value) && policy.clamp_infinity)
+				value = (value > 0) ? std::numeric_limits<T>::max() : std::numeric_limits<T>::lowest();
+
+			v = value;
+			return complete ? ParseResult::Number : ParseResult::Invalid;
+		}
+
+		template <typename T>
+		ParseResult parse_integer(std::string_view text, T& v, const NumericPolicy& policy)
+		{
+			text = trim(text);
+			if (text.empty())
+			{
+				v = 0;
+				return ParseResult::Empty;
+			}
+
+			const char* begin = text.data();
+			const char* const end = begin + text.size();
+			if (*begin == '+' && (end - begin) > 1 && begin[1] != '-')
+				++begin;
+
+			const auto [ptr, ec] = std::from_chars(begin, end, v);
+			if (ptr == end && ec == std::errc())
+				return ParseResult::Number;
+			if (ptr == end && ec == std::errc::result_out_of_range)
+			{
+				v = (*begin == '-') ? std::numeric_limits<T>::min() : std::numeric_limits<T>::max();
+				return ParseResult::Number;
+			}
+
+			// not an integer, e.g. "3.0" or "1e3", round the floating point value
+			double d;
+			const ParseResult result = parse_floating(text, d, policy);
+			if (std::isnan(d))
+				v = 0;
+			else if (d >= double(std::numeric_limits<T>::max()))
+				v = std::numeric_limits<T>::max();
+			else if (d <= double(std::numeric_limits<T>::min()))
+				v = std::numeric_limits<T>::min();
+			else
+				v = T(std::lround(d));
+			return result;
+		}
+	}
+
+	ParseResult parse_number(std::string_view text, float& v, const NumericPolicy& policy)
+	{
+		return parse_floating(text, v, policy);
+	}
+
+	ParseResult parse_number(std::string_view text, double& v, const NumericPolicy& policy)
+	{
+		return parse_floating(text, v, policy);
+	}
+
+	ParseResult parse_number(std::string_view text, biovault::bfloat16_t& v, const NumericPolicy& policy)
+	{
+		float f;
+		const ParseResult result = parse_floating(text, f, policy);
+		v = f;
+		return result;
+	}
+
+	ParseResult parse_number(std::string_view text, int& v, const NumericPolicy& policy)
+	{
+		return parse_integer(text, v, policy);
+	}
+
+	ParseResult parse_number(std::string_view text, std::int8_t& v, const NumericPolicy& policy)
+	{
+		return parse_integer(text, v, policy);
+	}
+
+	ParseResult parse_number(std::string_view text, std::uint8_t& v, const NumericPolicy& policy)
+	{
+		return parse_integer(text, v, policy);
+	}
+
+	ParseResult parse_number(std::string_view text, std::int16_t& v, const NumericPolicy& policy)
+	{
+		return parse_integer(text, v, policy);
+	}
+
+	ParseResult parse_number(std::string_view text, std::uint16_t& v, const NumericPolicy& policy)
+	{
+		return parse_integer(text, v, policy);
+	}
+
+	bool is_number(std::string_view text)
+	{
+		text = trim(text);
+		if (text.empty())
+			return true;
+
+		// fast path for the common [+-]digits[.digits], without building the value
+		std::string_view digits = text;
+		if (digits.front() == '+' || digits.front() == '-')
+			digits.remove_prefix(1);
+		const std::size_t point = digits.find('.');
+		const std::string_view integer = digits.substr(0, point);
+		const std::string_view fraction = (point == std::string_view::npos) ? std::string_view() : digits.substr(point + 1);
+		if ((integer.size() + fraction.size()) > 0 && all_digits(integer) && all_digits(fraction))
+			return true;
+
+		Decimal d;
+		if (scan_decimal(text, d))
+			return true;
+
+		double value;
+		NumericPolicy policy;
+		policy.number_prefix = false;
+		return parse_floating(text, value, policy) == ParseResult::Number;
+	}
+}
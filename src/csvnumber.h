@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#include <biovault_bfloat16/biovault_bfloat16.h>
+
+namespace ExtCsvLoader
+{
+	// How cells that do not hold a finite number are converted.
+	struct NumericPolicy
+	{
+		enum class Value { Zero, NaN };
+
+		Value empty = Value::Zero;		// empty cell
+		Value invalid = Value::Zero;	// cell that is not a number, e.g. "abc" or "1.5x"
+		bool number_prefix = true;		// an invalid cell that starts with a number, e.g. "1.5x" or "2e", is converted to that number, as atof does
+		bool allow_nan = true;			// "nan" is converted to NaN, otherwise it is treated as invalid
+		bool clamp_infinity = true;		// "inf" and out of range values become the largest finite value of the target type
+	};
+
+	enum class ParseResult { Number, Empty, Invalid };
+
+	// Locale independent conversion of a complete item (surrounding spaces and tabs are ignored).
+	// Simple decimals are converted exactly with a single multiplication or division in the target type,
+	// everything else goes through std::from_chars, so a float is never parsed via a double. Hexadecimal numbers,
+	// inf and nan are read as strtod reads them. An item that only starts with a number is Invalid, its value is
+	// then that number when the policy allows a number prefix.
+	ParseResult parse_number(std::string_view text, float& v, const NumericPolicy& policy = {});
+	ParseResult parse_number(std::string_view text, double& v, const NumericPolicy& policy = {});
+	ParseResult parse_number(std::string_view text, biovault::bfloat16_t& v, const NumericPolicy& policy = {});
+	// Integers are parsed exactly, other numbers are rounded to the nearest integer and saturated to the range of the type.
+	// Empty and invalid cells, NaN included, become 0.
+	ParseResult parse_number(std::string_view text, int& v, const NumericPolicy& policy = {});
+	ParseResult parse_number(std::string_view text, std::int8_t& v, const NumericPolicy& policy = {});
+	ParseResult parse_number(std::string_view text, std::uint8_t& v, const NumericPolicy& policy = {});
+	ParseResult parse_number(std::string_view text, std::int16_t& v, const NumericPolicy& policy = {});
+	ParseResult parse_number(std::string_view text, std::uint16_t& v, const NumericPolicy& policy = {});
+
+	// true when text is empty or a number that parse_number accepts
+	bool is_number(std::string_view text);
+}
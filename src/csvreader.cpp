@@ -1,16 +1,25 @@
 #include "csvreader.h"
 
+#include "csvdecompress.h"
+#include "csvscanner.h"
+
+#include <QStringDecoder>
+
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
+#include <numeric>
 #include <unordered_map>
 
 namespace ExtCsvLoader
 {
-	void initialize_header(std::vector<std::string>& header, const std::string& prefix)
+	void initialize_header(Labels& header, const std::size_t size, const std::string& prefix)
 	{
-		std::size_t size = header.size();
-		for (auto i = 0; i < size; ++i)
+		header.clear();
+		for (std::size_t i = 0; i < size; ++i)
 		{
-			header[i] = prefix +  std::to_string(i);
+			header.push_back(prefix + std::to_string(i));
 		}
 	}
 
@@ -25,10 +34,11 @@ namespace ExtCsvLoader
 	}
 
 
-	void create_target_index_vector(const std::vector<std::string>& labels, const std::vector<std::string>& selected_labels, std::vector<std::ptrdiff_t>& result)
+	void create_target_index_vector(const Labels& labels, const std::vector<std::string>& selected_labels, std::vector<std::ptrdiff_t>& result)
 	{
-		std::vector<std::unordered_map<std::string, std::ptrdiff_t>> temp(omp_get_max_threads());
-		std::unordered_map<std::string, std::ptrdiff_t>& dimension_labels_map = temp[0];
+		// the map refers to the selected labels, no label is copied
+		std::vector<std::unordered_map<std::string_view, std::ptrdiff_t>> temp(omp_get_max_threads());
+		std::unordered_map<std::string_view, std::ptrdiff_t>& dimension_labels_map = temp[0];
 #pragma omp parallel for
 		for (std::ptrdiff_t i = 0; i < selected_labels.size(); ++i)
 		{
@@ -52,6 +62,118 @@ namespace ExtCsvLoader
 		}
 	}
 
+	// leading spaces, tabs and quotes and trailing spaces and tabs are not part of a column label
+	std::string_view trim_label(std::string_view label)
+	{
+		while (!label.empty() && (label.front() == SPACE || label.front() == TAB || label.front() == QUOTE))
+			label.remove_prefix(1);
+		while (!label.empty() && (label.back() == SPACE || label.back() == TAB))
+			label.remove_suffix(1);
+		return label;
+	}
+
+	bool split_lines(std::string_view text, std::vector<std::string_view>& lines)
+	{
+		lines.clear();
+		if (text.empty())
+			return true;
+
+		// split the text in chunks of at least 1MB, one or more per thread
+		constexpr std::size_t min_chunk_size = 1 << 20;
+		const std::size_t nrOfChunks = std::max<std::size_t>(1, std::min<std::size_t>(text.size() / min_chunk_size, 4 * omp_get_max_threads()));
+		const std::size_t chunk_size = (text.size() + nrOfChunks - 1) / nrOfChunks;
+		auto chunk = [&](std::size_t c)
+		{
+			return text.substr(std::min(c * chunk_size, text.size()), chunk_size);
+		};
+
+		// a newline inside a quoted item does not end the line, so first find out for each chunk if it starts inside a quote
+		std::vector<std::size_t> nrOfQuotes(nrOfChunks);
+		#pragma omp parallel for schedule(static,1)
+		for (std::ptrdiff_t c = 0; c < std::ptrdiff_t(nrOfChunks); ++c)
+		{
+			const std::string_view current = chunk(c);
+			nrOfQuotes[c] = count_matches(current, QUOTE);
+		}
+		std::vector<uint8_t> starts_inside_quote(nrOfChunks, 0);
+		for (std::size_t c = 1; c < nrOfChunks; ++c)
+		{
+			starts_inside_quote[c] = (starts_inside_quote[c - 1] + nrOfQuotes[c - 1]) % 2;
+		}
+
+		// find the line endings in every chunk in parallel, merging them in chunk order keeps the line order deterministic
+		std::vector<std::vector<std::size_t>> line_ends(nrOfChunks);
+		#pragma omp parallel for schedule(static,1)
+		for (std::ptrdiff_t c = 0; c < std::ptrdiff_t(nrOfChunks); ++c)
+		{
+			const std::string_view current = chunk(c);
+			const std::size_t chunk_offset = c * chunk_size;
+			std::vector<std::size_t>& ends = line_ends[c];
+			if (nrOfQuotes[c] == 0 && !starts_inside_quote[c])
+			{
+				for (const char* pos = current.data(), * end = current.data() + current.size(); (pos = static_cast<const char*>(memchr(pos, '\n', end - pos))) != nullptr; ++pos)
+					ends.push_back(chunk_offset + (pos - current.data()));
+			}
+			else
+			{
+				bool insideQuote = starts_inside_quote[c];
+				for_each_match(current, QUOTE, '\n', [&](const std::size_t pos)
+				{
+					if (current[pos] == QUOTE)
+						insideQuote = !insideQuote;
+					else if (!insideQuote)
+						ends.push_back(chunk_offset + pos);
+				});
+			}
+		}
+
+		std::size_t nrOfLines = 1;
+		for (const auto& ends : line_ends)
+			nrOfLines += ends.size();
+		lines.reserve(nrOfLines);
+
+		std::size_t line_begin = 0;
+		bool too_long = false;
+		auto add_line = [&](std::size_t line_end)
+		{
+			std::string_view line = text.substr(line_begin, line_end - line_begin);
+			if (!line.empty() && line.back() == '\r')
+				line.remove_suffix(1);
+			if (!line.empty())
+				lines.push_back(line);
+			too_long = too_long || (line.size() > CsvBuffer::max_line_size);
+			line_begin = line_end + 1;
+		};
+		for (const auto& ends : line_ends)
+			for (const std::size_t line_end : ends)
+				add_line(line_end);
+		if (line_begin < text.size())
+			add_line(text.size());
+
+		if (too_long)
+			lines.clear();
+		return !too_long;
+	}
+
+	double seconds_since(const std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	QDebug operator<<(QDebug debug, const LoadStats& stats)
+	{
+		QDebugStateSaver saver(debug);
+		debug.nospace() << stats.rows << " x " << stats.columns << " (" << stats.selected_rows << " x " << stats.selected_columns << " selected), "
+			<< double(stats.bytes) / (1024.0 * 1024.0) << " MB"
+			<< ", read " << stats.read_seconds << "s"
+			<< ", parse " << stats.parse_seconds << "s (tokenize " << stats.tokenize_seconds << "s thread time)"
+			<< ", type detection " << stats.type_detection_seconds << "s"
+			<< ", clusters " << stats.cluster_seconds << "s"
+			<< ", datasets " << stats.dataset_seconds << "s"
+			<< ", peak " << double(stats.peak_bytes) / (1024.0 * 1024.0) << " MB";
+		return debug;
+	}
+
 	CSVReader::CSVReader(const QString& _filename, const char _separator, bool with_column_header, bool with_row_header)
 	{
 		m_filename = _filename;
@@ -60,17 +182,22 @@ namespace ExtCsvLoader
 		m_with_row_header = with_row_header;
 		m_nrOfColumns = 0;
 		m_nrOfRows = 0;
+		m_complete = false;
+		m_text_partial = false;
+		m_cancelled = false;
+		m_reported_rows = 0;
+		m_transform = TRANSFORM::NONE;
 	};
 
 	std::string CSVReader::GetColumnRowHeader() const
 	{
 		return m_column_row_header;
 	}
-	const std::vector<std::string>& CSVReader::GetColumnHeader() const
+	const Labels& CSVReader::GetColumnHeader() const
 	{
 		return m_column_header;
 	}
-	const std::vector<std::string>& CSVReader::GetRowHeader() const
+	const Labels& CSVReader::GetRowHeader() const
 	{
 		return m_row_header;
 	}
@@ -85,143 +212,643 @@ namespace ExtCsvLoader
 		return m_nrOfRows;
 	};
 
-	void CSVReader::read()
+	void CSVReader::set_numeric_policy(const NumericPolicy& policy)
 	{
-		m_data.clear();
-		QFile qFile(m_filename);
-		if (!qFile.open(QIODevice::ReadOnly | QIODevice::Text))
+		m_numeric_policy = policy;
+	}
+
+	const NumericPolicy& CSVReader::numeric_policy() const
+	{
+		return m_numeric_policy;
+	}
+
+	void CSVReader::set_transform(TRANSFORM::Type transform)
+	{
+		m_transform = transform;
+	}
+
+	CSVReader::TRANSFORM::Type CSVReader::transform() const
+	{
+		return m_transform;
+	}
+
+	void CSVReader::transform_values(float* values, const std::size_t count) const
+	{
+		// one loop without branches per transform, so the compiler can vectorize it
+		const std::ptrdiff_t n = std::ptrdiff_t(count);
+		switch (m_transform)
 		{
-			//qDebug() << "problem reading file " << m_filename;
-			return;
+		case TRANSFORM::LOG:
+		{
+			constexpr float inverse_ln2 = 1.4426950408889634f;
+			#pragma omp simd
+			for (std::ptrdiff_t i = 0; i < n; ++i)
+				values[i] = std::log1p(values[i]) * inverse_ln2;
+			break;
 		}
-		QTextStream FileStream(&qFile);
-		
+		case TRANSFORM::SQRT:
+			#pragma omp simd
+			for (std::ptrdiff_t i = 0; i < n; ++i)
+				values[i] = std::sqrt(values[i]);
+			break;
+		case TRANSFORM::ARCSIN5:
+			#pragma omp simd
+			for (std::ptrdiff_t i = 0; i < n; ++i)
+				values[i] = std::asinh(values[i] * 0.2f);
+			break;
+		default:
+			break;
+		}
+	}
 
-		// read the first line and determine the number of attributes
-		 std::string firstLine = FileStream.readLine().toStdString();
+	void CSVReader::set_progress_function(ProgressFunction f)
+	{
+		m_progress = std::move(f);
+	}
 
-		 CsvBuffer header(std::move(firstLine));
-		header.process(m_separator);
-		 
-		
-		const std::size_t nrOfBufferItems = header.size();
+	void CSVReader::cancel()
+	{
+		m_cancelled = true;
+	}
 
-		if (nrOfBufferItems == 0)
+	bool CSVReader::cancelled() const
+	{
+		return m_cancelled.load(std::memory_order_relaxed);
+	}
+
+	bool CSVReader::complete() const
+	{
+		return m_complete;
+	}
+
+	const LoadStats& CSVReader::stats() const
+	{
+		return m_stats;
+	}
+
+	LoadStats& CSVReader::stats()
+	{
+		return m_stats;
+	}
+
+	void CSVReader::note_allocation(const std::size_t bytes)
+	{
+		const std::size_t held = m_text_buffer.capacity() + (m_data.capacity() * sizeof(CsvBuffer));
+		m_stats.peak_bytes = std::max(m_stats.peak_bytes, held + bytes);
+	}
+
+	void CSVReader::row_done(std::atomic<std::size_t>& rows_done, const std::size_t total, const char* phase)
+	{
+		const std::size_t done = rows_done.fetch_add(1, std::memory_order_relaxed) + 1;
+		if (!m_progress || omp_get_thread_num() != 0)
 			return;
 
-		if (m_with_row_header)
+		// a few hundred updates per phase are enough for a progress bar
+		if (done < m_reported_rows)
+			m_reported_rows = 0;	// a new phase
+		if (done == total || done - m_reported_rows >= std::max<std::size_t>(1, total / 200))
 		{
-			if (m_with_column_header)
+			m_reported_rows = done;
+			m_progress(phase, float(done) / float(total));
+		}
+	}
+
+	void CSVReader::select_targets(bool transposed, Labels& column_header, Labels& row_header, const std::vector<std::string>& parent_labels, const std::vector<std::string>& dimension_labels, std::vector<std::ptrdiff_t>& target_row_index, std::vector<std::ptrdiff_t>& target_column_index) const
+	{
+		target_row_index.resize(m_nrOfRows);
+		std::iota(target_row_index.begin(), target_row_index.end(), std::ptrdiff_t(0));
+		target_column_index.resize(m_nrOfColumns);
+		std::iota(target_column_index.begin(), target_column_index.end(), std::ptrdiff_t(0));
+
+		// the labels of the reader are shared, not copied, so this costs nothing for every pass over the file
+		if(parent_labels.empty())
+		{
+			column_header = m_column_header;
+			row_header = m_row_header;
+		}
+		else
+		{
+
+			if (transposed && m_with_column_header)
 			{
-				header.getAs(0, m_column_row_header);
+				create_target_index_vector(m_column_header, parent_labels, target_column_index);
+				
+				column_header = Labels(parent_labels);
+				row_header = m_row_header;
+			}
+			else if (!transposed && m_with_row_header)
+			{
+				create_target_index_vector(m_row_header, parent_labels, target_row_index);
+				
+				row_header = Labels(parent_labels);
+				column_header = m_column_header;
 			}
+			qDebug() << "parent labels matched";
 		}
+		
 
-		m_nrOfColumns = m_with_row_header ? nrOfBufferItems - 1 : nrOfBufferItems;
+		if(!dimension_labels.empty())
+		{
+			if (!transposed && m_with_column_header)
+			{
+				create_target_index_vector(m_column_header, dimension_labels, target_column_index);
+				
+				column_header = Labels(dimension_labels);
+			}
 
-		//qDebug() << m_nrOfColumns << " columns\n";
+			qDebug() << "dimension labels matched";
+		}
+	}
 
-		m_column_header.resize(m_nrOfColumns);
+	bool CSVReader::open_text(const std::size_t max_rows)
+	{
+		m_text = std::string_view();
+		m_text_buffer.clear();
+		if (m_file.isOpen())
+			m_file.close(); // also unmaps the previous mapping
 
-		if (!m_with_column_header)
+		m_file.setFileName(m_filename);
+		if (!m_file.open(QIODevice::ReadOnly))
 		{
-			m_column_header.resize(m_nrOfColumns);
-			ExtCsvLoader::initialize_header(m_column_header, "VAR");
+			//qDebug() << "problem reading file " << m_filename;
+			return false;
+		}
+
+		const qint64 fileSize = m_file.size();
+		if (fileSize <= 0)
+			return false;
+
+		// map the file so lines and items can be views on the file instead of copies of it
+		if (const uchar* mapping = m_file.map(0, fileSize))
+		{
+			m_text = std::string_view(reinterpret_cast<const char*>(mapping), fileSize);
 		}
 		else
 		{
+			m_text_buffer = m_file.readAll().toStdString();
+			m_text = m_text_buffer;
+		}
 
-			if (m_with_row_header)
+		// a compressed file is decompressed in memory instead of to a temporary file
+		m_text_partial = false;
+		const Compression compression = detect_compression(m_text);
+		if (compression != Compression::None)
+		{
+			if (!compression_supported(compression))
 			{
-#pragma omp parallel for
-				for (std::ptrdiff_t column_index = 0; column_index < m_nrOfColumns; ++column_index)
+				qWarning() << m_filename << " is compressed with " << compression_name(compression) << ", which this build does not support";
+				return false;
+			}
+			// for a sample the stream is decompressed until it holds the header and max_rows complete lines, or a line
+			// that is too long to read anyway. The line ends are found as split_lines finds them
+			std::size_t nrOfLineEnds = 0;
+			std::size_t size = 0;
+			std::size_t line_begin = 0;
+			bool insideQuote = false;
+			auto enough = [&](const std::string_view added_text)
+			{
+				for_each_match(added_text, QUOTE, '\n', [&](const std::size_t pos)
 				{
-					header.getAs(column_index + 1, m_column_header[column_index]);
-				}
+					if (added_text[pos] == QUOTE)
+					{
+						insideQuote = !insideQuote;
+					}
+					else if (!insideQuote)
+					{
+						++nrOfLineEnds;
+						line_begin = size + pos + 1;
+					}
+				});
+				size += added_text.size();
+				return (nrOfLineEnds > max_rows + 1) || (size - line_begin > CsvBuffer::max_line_size);
+			};
+
+			std::string text;
+			bool complete = false;
+			const bool sample = (max_rows < std::numeric_limits<std::size_t>::max());
+			if (!decompress(m_text, compression, text, complete, sample ? EnoughFunction(enough) : EnoughFunction()))
+			{
+				qWarning() << "Could not decompress " << m_filename;
+				return false;
 			}
-			else
+			m_file.close();
+			m_text_buffer = std::move(text);
+			m_text = m_text_buffer;
+			m_text_partial = !complete;
+		}
+
+		constexpr std::string_view utf8_bom("\xEF\xBB\xBF");
+		if (m_text.substr(0, utf8_bom.size()) == utf8_bom)
+		{
+			m_text.remove_prefix(utf8_bom.size());
+		}
+		else if (m_text.size() >= 2 && (m_text[0] == '\xFE' || m_text[0] == '\xFF'))
+		{
+			// UTF-16 or UTF-32 byte order mark, this is the only case in which we still need to decode the file
+			const auto encoding = QStringConverter::encodingForData(QByteArrayView(m_text.data(), m_text.size()));
+			if (encoding && (*encoding != QStringConverter::Utf8))
 			{
-#pragma omp parallel for
-				for (std::ptrdiff_t column_index = 0; column_index < m_nrOfColumns; ++column_index)
+				QStringDecoder decoder(*encoding);
+				m_text_buffer = decoder.decode(QByteArrayView(m_text.data(), m_text.size())).toUtf8().toStdString();
+				m_text = m_text_buffer;
+			}
+		}
+		return true;
+	}
+
+	void CSVReader::select_labels(bool transposed, Labels& column_header, Labels& row_header, const std::vector<std::string>& parent_labels, const std::vector<std::string>& dimension_labels) const
+	{
+		std::vector<std::ptrdiff_t> target_row_index;
+		std::vector<std::ptrdiff_t> target_column_index;
+		select_targets(transposed, column_header, row_header, parent_labels, dimension_labels, target_row_index, target_column_index);
+		if (transposed)
+			std::swap(column_header, row_header);
+	}
+
+	std::vector<std::pair<std::size_t, std::size_t>> CSVReader::selected_items(const std::vector<std::ptrdiff_t>& target_column_index) const
+	{
+		const std::size_t column_offset = m_with_row_header ? 1 : 0;
+		std::vector<std::pair<std::size_t, std::size_t>> result;
+		for (std::size_t j = 0; j < target_column_index.size(); ++j)
+		{
+			if (target_column_index[j] >= 0)
+				result.emplace_back(j + column_offset, std::size_t(target_column_index[j]));
+		}
+		return result;
+	}
+
+	bool CSVReader::get_sparse_data(bool transposed, Labels& column_header, Labels& row_header, const std::vector<std::string>& parent_labels, const std::vector<std::string>& dimension_labels, SparseRows& result)
+	{
+		result = SparseRows();
+		std::vector<std::ptrdiff_t> target_row_index;
+		std::vector<std::ptrdiff_t> target_column_index;
+		select_targets(transposed, column_header, row_header, parent_labels, dimension_labels, target_row_index, target_column_index);
+		m_stats.selected_rows = row_header.size();
+		m_stats.selected_columns = column_header.size();
+		const auto items = selected_items(target_column_index);
+		const std::size_t nrOfBufferItems = items.empty() ? 0 : items.back().first + 1;
+
+		// a line of the file is a row of the result, or a column when transposed
+		const std::size_t nrOfLines = row_header.size();
+		const std::size_t nrOfLineItems = column_header.size();
+		if (nrOfLines == 0 || nrOfLineItems == 0)
+			return false;
+		const auto start = std::chrono::steady_clock::now();
+
+		// the non-zero values of a block of lines of the file, every thread fills its own blocks
+		struct Line
+		{
+			std::size_t target;
+			std::size_t first;
+			std::size_t size;
+		};
+		struct Block
+		{
+			std::vector<Line> lines;
+			std::vector<std::uint32_t> indices;
+			std::vector<float> values;
+		};
+		constexpr std::size_t block_lines = 256;
+		std::vector<Block> blocks((m_nrOfRows + block_lines - 1) / block_lines);
+
+		std::atomic<std::size_t> rows_done = 0;
+		std::vector<std::chrono::steady_clock::duration> tokenize_time(omp_get_max_threads(), std::chrono::steady_clock::duration::zero());
+		#pragma omp parallel for schedule(dynamic,1)
+		for (std::ptrdiff_t b = 0; b < std::ptrdiff_t(blocks.size()); ++b)
+		{
+			Block& block = blocks[b];
+			const std::size_t last_row = std::min((std::size_t(b) + 1) * block_lines, m_nrOfRows);
+			for (std::size_t i = std::size_t(b) * block_lines; i < last_row && !cancelled(); ++i)
+			{
+				const std::ptrdiff_t row_index = target_row_index[i];
+				if (row_index < 0)
+					continue;
+
+				ExtCsvLoader::CsvBuffer& csvbuffer = m_data[i];
+				if (!csvbuffer.processed())
+				{
+					const auto tokenize_start = std::chrono::steady_clock::now();
+					csvbuffer.process(m_separator, nrOfBufferItems, nrOfBufferItems);
+					tokenize_time[omp_get_thread_num()] += std::chrono::steady_clock::now() - tokenize_start;
+				}
+
+				const std::size_t first = block.values.size();
+				const std::size_t nrOfItems = csvbuffer.size();
+				for (const auto& [item, column_index] : items)
 				{
-					header.getAs(column_index, m_column_header[column_index]);
+					const std::string_view text = (item < nrOfItems) ? csvbuffer[item] : std::string_view();
+					float value = 0;
+					parse_number(text, value, m_numeric_policy);
+					// a NaN is not zero, so it is kept
+					if (value != 0.0f)
+					{
+						block.indices.push_back(std::uint32_t(column_index));
+						block.values.push_back(value);
+					}
 				}
+				transform_values(block.values.data() + first, block.values.size() - first);
+				block.lines.push_back({ std::size_t(row_index), first, block.values.size() - first });
+				csvbuffer.release();
+				row_done(rows_done, nrOfLines, "Parsing");
 			}
+		}
+		for (const auto& duration : tokenize_time)
+			m_stats.tokenize_seconds += std::chrono::duration<double>(duration).count();
 
-			// remove any SPACE's or TAB's at the beginning and end of each header field
-			for (auto attribute = 0; attribute < m_nrOfColumns; attribute++)
+		if (!cancelled())
+		{
+			// when several lines of the file have the same label, the first one is loaded
+			std::vector<std::uint64_t> offsets(nrOfLines + 1, 0);
+			std::vector<std::uint8_t> filled(nrOfLines, 0);
+			std::size_t nrOfValues = 0;
+			for (Block& block : blocks)
 			{
-				// remove any SPACE's or TAB's at the beginning of field
-				if (m_column_header[attribute].size())
+				nrOfValues += block.values.size();
+				for (Line& line : block.lines)
 				{
-					while (*(m_column_header[attribute].begin()) == SPACE || *(m_column_header[attribute].begin()) == TAB || *(m_column_header[attribute].begin()) == QUOTE)
+					if (filled[line.target])
 					{
-						//qDebug() << "space, tab or quote removed";
-						m_column_header[attribute].erase(m_column_header[attribute].begin());
+						line.size = 0;
+						continue;
 					}
+					filled[line.target] = 1;
+					offsets[line.target + 1] = line.size;
 				}
+			}
+			std::partial_sum(offsets.cbegin(), offsets.cend(), offsets.begin());
+			note_allocation((nrOfValues + offsets.back()) * (sizeof(std::uint32_t) + sizeof(float)));
+
+			result.offsets = std::move(offsets);
+			result.columns.resize(result.offsets.back());
+			result.values.resize(result.offsets.back());
+			#pragma omp parallel for schedule(dynamic,1)
+			for (std::ptrdiff_t b = 0; b < std::ptrdiff_t(blocks.size()); ++b)
+			{
+				Block& block = blocks[b];
+				for (const Line& line : block.lines)
+				{
+					const std::size_t target = result.offsets[line.target];
+					std::copy_n(block.indices.cbegin() + line.first, line.size, result.columns.begin() + target);
+					std::copy_n(block.values.cbegin() + line.first, line.size, result.values.begin() + target);
+				}
+				block = Block();
+			}
 
-				if (m_column_header[attribute].size())
+			// the lines are the columns of the result, they are turned into rows with a counting sort on the row index
+			if (transposed)
+			{
+				SparseRows rows;
+				rows.offsets.assign(nrOfLineItems + 1, 0);
+				for (const std::uint32_t row : result.columns)
+					++rows.offsets[row + 1];
+				std::partial_sum(rows.offsets.cbegin(), rows.offsets.cend(), rows.offsets.begin());
+				rows.columns.resize(result.columns.size());
+				rows.values.resize(result.values.size());
+				std::vector<std::uint64_t> next(rows.offsets.cbegin(), rows.offsets.cend() - 1);
+				for (std::size_t column = 0; column < nrOfLines; ++column)
 				{
-					// and do the same for the end of header[attribute]
-					while (*(m_column_header[attribute].rbegin()) == SPACE || *(m_column_header[attribute].rbegin()) == TAB || *(m_column_header[attribute].begin()) == QUOTE)
+					for (std::uint64_t k = result.offsets[column]; k < result.offsets[column + 1]; ++k)
 					{
-						//qDebug() << "space, tab or quote removed";
-						m_column_header[attribute].resize(m_column_header[attribute].size() - 1, SPACE);
+						const std::uint64_t target = next[result.columns[k]]++;
+						rows.columns[target] = std::uint32_t(column);
+						rows.values[target] = result.values[k];
 					}
 				}
+				result = std::move(rows);
+			}
+		}
+		m_stats.parse_seconds += seconds_since(start);
+
+		if (transposed)
+			std::swap(column_header, row_header);
+		if (cancelled())
+		{
+			result = SparseRows();
+			return false;
+		}
+		return true;
+	}
 
+	double CSVReader::zero_fraction(const std::size_t max_rows)
+	{
+		const std::size_t column_offset = m_with_row_header ? 1 : 0;
+		const std::size_t nrOfRows = std::min(max_rows, m_nrOfRows);
+		std::size_t cells = 0;
+		std::size_t zeros = 0;
+		for (std::size_t i = 0; i < nrOfRows; ++i)
+		{
+			ExtCsvLoader::CsvBuffer& csvbuffer = m_data[i];
+			if (!csvbuffer.processed())
+				csvbuffer.process(m_separator, m_nrOfColumns + column_offset);
+			for (std::size_t item = column_offset; item < std::size_t(csvbuffer.size()); ++item)
+			{
+				float value = 0;
+				parse_number(csvbuffer[item], value, m_numeric_policy);
+				++cells;
+				if (value == 0.0f)
+					++zeros;
 			}
+			csvbuffer.release();
 		}
-		
+		return cells ? double(zeros) / double(cells) : 0.0;
+	}
+
+	void CSVReader::read(const std::size_t max_rows)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		m_stats = LoadStats();
+		m_reported_rows = 0;
+		if (m_progress)
+			m_progress("Reading", 0.0f);
+
+		m_data.clear();
+		m_column_header.clear();
+		m_row_header.clear();
+		m_column_row_header.clear();
+		m_nrOfColumns = 0;
+		m_nrOfRows = 0;
+		m_complete = false;
+		// for a sample of a compressed file only the start of it is decompressed, enough for the header and max_rows rows
+		if (!open_text(max_rows))
+			return;
+		m_stats.bytes = m_text.size();
+
+		std::size_t text_pos = 0;
+		auto next_line = [this, &text_pos]()
+		{
+			// a newline inside a quoted item does not end the line, the same as in split_lines
+			const std::size_t begin = text_pos;
+			const std::string_view rest = m_text.substr(begin);
+			std::size_t end = m_text.size();
+			bool insideQuote = false;
+			for_each_match(rest, QUOTE, '\n', [&](const std::size_t pos)
+			{
+				if (rest[pos] == QUOTE)
+					insideQuote = !insideQuote;
+				else if (!insideQuote)
+				{
+					end = begin + pos;
+					return false;
+				}
+				return true;
+			});
+			text_pos = end + 1;
+
+			std::string_view line = m_text.substr(begin, end - begin);
+			if (!line.empty() && line.back() == '\r')
+				line.remove_suffix(1);
+			return line;
+		};
+
+		// read the first line and determine the number of attributes
+		const std::string_view header_line = next_line();
+		if (header_line.size() > CsvBuffer::max_line_size)
+		{
+			qWarning() << m_filename << " has a line longer than 4 GiB, which can not be read";
+			return;
+		}
+		CsvBuffer header(header_line);
+		header.process(m_separator);
+
+		const std::size_t nrOfBufferItems = header.size();
+
+		if (nrOfBufferItems == 0)
+			return;
+
+		if (m_with_row_header)
+		{
+			if (m_with_column_header)
+			{
+				header.getAs(0, m_column_row_header);
+			}
+		}
+
+		m_nrOfColumns = m_with_row_header ? nrOfBufferItems - 1 : nrOfBufferItems;
+
+		//qDebug() << m_nrOfColumns << " columns\n";
+
 		if (!m_with_column_header)
+		{
+			ExtCsvLoader::initialize_header(m_column_header, m_nrOfColumns, "VAR");
+		}
+		else
+		{
+			// the labels are views on the header line until they are copied into the header in one go
+			const std::size_t first_label = m_with_row_header ? 1 : 0;
+			std::vector<std::string_view> column_labels(m_nrOfColumns);
+			for (std::size_t column_index = 0; column_index < m_nrOfColumns; ++column_index)
+			{
+				column_labels[column_index] = trim_label(header[column_index + first_label]);
+			}
+			m_column_header = Labels(column_labels);
+		}
+		
+		if (!m_with_column_header && max_rows > 0)
 			m_data.push_back(header);
 		
 
-		while (!FileStream.atEnd())
+		if (text_pos < m_text.size())
 		{
-			std::string line = FileStream.readLine().toStdString();
-			//getline(file, line);
-			if (!line.empty())
+			std::vector<std::string_view> lines;
+			bool lines_fit = true;
+			std::string_view text = m_text.substr(text_pos);
+			if (max_rows < std::numeric_limits<std::size_t>::max())
 			{
-				m_data.push_back(CsvBuffer(std::move(line)));
+				// only split a prefix of the text that holds the requested rows, its last line can be cut off
+				const std::size_t max_lines = max_rows - std::min(max_rows, m_data.size());
+				std::size_t prefix_size = std::size_t(1) << 16;
+				for (;; prefix_size *= 2)
+				{
+					lines_fit = split_lines(text.substr(0, prefix_size), lines);
+					if (!lines_fit || prefix_size >= text.size() || lines.size() > max_lines)
+						break;
+				}
+				if ((prefix_size < text.size() || m_text_partial) && !lines.empty())
+					lines.pop_back();
+				if (lines.size() > max_lines)
+					lines.resize(max_lines);
+				else if (prefix_size >= text.size() && !m_text_partial)
+					m_complete = true;
 			}
+			else
+			{
+				lines_fit = split_lines(text, lines);
+				m_complete = true;
+			}
+			if (!lines_fit)
+			{
+				qWarning() << m_filename << " has a line longer than 4 GiB, which can not be read";
+				m_data.clear();
+				m_column_header.clear();
+				m_nrOfColumns = 0;
+				m_complete = false;
+				return;
+			}
+			note_allocation((lines.capacity() * sizeof(std::string_view)) + (lines.size() * sizeof(CsvBuffer)));
+
+			const std::size_t first_line = m_data.size();
+			m_data.resize(first_line + lines.size());
+			#pragma omp parallel for
+			for (std::ptrdiff_t i = 0; i < std::ptrdiff_t(lines.size()); ++i)
+			{
+				m_data[first_line + i] = CsvBuffer(lines[i]);
+			}
+		}
+		else
+		{
+			m_complete = true;
 		}
 		m_nrOfRows = m_data.size();
-		m_row_header.resize(m_nrOfRows);
 		//qDebug() << QString("data loaded");
 		if (m_with_row_header)
 		{
-			if (m_with_column_header)
+			if (m_with_column_header && !m_data.empty())
 			{
 				// fix situation where there is a row and column header but no string for the column_row_header_item;
+				// the first row has to have exactly one item more than the header, so one more item is enough to tell
 				ExtCsvLoader::CsvBuffer& csvbuffer = m_data[0];
-				if (!csvbuffer.processed())
-					csvbuffer.process(m_separator, m_nrOfColumns + 1);
+				csvbuffer.process(m_separator, m_nrOfColumns + 2, m_nrOfColumns + 3);
+				const bool lacking_item = (csvbuffer.size() == std::ptrdiff_t(m_nrOfColumns + 2));
+				csvbuffer.release();
 
-				if (csvbuffer.size() == (m_nrOfColumns + 2))
+				if (lacking_item)
 				{
 					// header was lacking a row+column header item
-					m_column_header.insert(m_column_header.begin(), m_column_row_header);
+					Labels column_header;
+					column_header.push_back(m_column_row_header);
+					column_header.append(m_column_header);
+					m_column_header = std::move(column_header);
 					m_nrOfColumns += 1;
 					m_column_row_header = "";
 				}
 			}
-			const std::size_t nrOfBufferItems = m_with_row_header ? m_nrOfColumns + 1 : m_nrOfColumns;
+			// only the first item of every row is needed here, the rest of the row is tokenized when its data is selected.
+			// the labels are views on the text until they are copied into the header in one go
+			std::vector<std::string_view> row_labels(m_nrOfRows);
+			std::atomic<std::size_t> rows_done = 0;
 			#pragma  omp parallel for schedule(dynamic,1)
 			for (std::ptrdiff_t i = 0; i < m_nrOfRows; ++i)
 			{
 				ExtCsvLoader::CsvBuffer& csvbuffer = m_data[i];
-				if (!csvbuffer.processed())
-					csvbuffer.process(m_separator, nrOfBufferItems);
-				csvbuffer.getAs(0, m_row_header[i]);
+				csvbuffer.process(m_separator, 1, 1);
+				if (csvbuffer.size())
+					row_labels[i] = csvbuffer[0];
+				csvbuffer.release();
+				row_done(rows_done, m_nrOfRows, "Reading");
 			}
+			note_allocation(row_labels.capacity() * sizeof(std::string_view));
+			m_row_header = Labels(row_labels);
 			//qDebug() << QString("data processed");
 		}
 		else
 		{
-			ExtCsvLoader::initialize_header(m_row_header, "");
+			ExtCsvLoader::initialize_header(m_row_header, m_nrOfRows, "");
 		}
+		m_stats.rows = m_nrOfRows;
+		m_stats.columns = m_nrOfColumns;
+		m_stats.read_seconds = seconds_since(start);
+		if (m_progress)
+			m_progress("Reading", 1.0f);
 		qDebug() << m_nrOfColumns << " x " << m_nrOfRows << " loaded and processed";
 	}
 }
@@ -1,13 +1,21 @@
 #pragma once
 
 #include "csvbuffer.h"
+#include "csvlabels.h"
 
 #include <QDebug>
 #include <QFile>
-#include <QTextStream>
 
 #include <omp.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
 constexpr auto SPACE = ' ';
 constexpr auto TAB = '\t';
 constexpr auto REPLACEMENT_SEPARATOR = '_';
@@ -29,25 +37,68 @@ namespace ExtCsvLoader
 		}
 	}
 
-	void initialize_header(std::vector<std::string>& header, const std::string& prefix);
+	void initialize_header(Labels& header, const std::size_t size, const std::string& prefix);
 	std::string searchandreplace(std::string _input, const char _search, const char _replace);
 
-	void create_target_index_vector(const std::vector<std::string>& labels, const std::vector<std::string>& selected_labels, std::vector<std::ptrdiff_t>& result);
+	// splits text into non-empty lines, newlines inside quoted items do not end a line.
+	// False (and no lines) when a line is longer than a CsvBuffer can hold.
+	bool split_lines(std::string_view text, std::vector<std::string_view>& lines);
+
+	// counters and timings of the phases of a load
+	struct LoadStats
+	{
+		std::size_t bytes = 0;					// size of the text
+		std::size_t rows = 0;
+		std::size_t columns = 0;
+		std::size_t selected_rows = 0;
+		std::size_t selected_columns = 0;
+		double read_seconds = 0;				// open or map the file, split it into lines and read the headers
+		double parse_seconds = 0;				// tokenize and convert the selected cells
+		double tokenize_seconds = 0;			// time spent tokenizing, summed over the threads
+		double type_detection_seconds = 0;
+		double cluster_seconds = 0;
+		double dataset_seconds = 0;
+		std::size_t peak_bytes = 0;				// largest amount of memory held by the buffers of the load at the same time, the mapped file excluded
+	};
+
+	QDebug operator<<(QDebug debug, const LoadStats& stats);
+
+	double seconds_since(const std::chrono::steady_clock::time_point start);
+
+	// Called with the name of a phase and the fraction of it that is done, always from the thread that started the phase.
+	using ProgressFunction = std::function<void(const char* phase, float fraction)>;
+
+	// Compressed sparse rows: the non-zero values of row r are values[offsets[r]] up to values[offsets[r + 1]],
+	// columns holds the column of every value
+	struct SparseRows
+	{
+		std::vector<std::uint64_t> offsets;
+		std::vector<std::uint32_t> columns;
+		std::vector<float> values;
+	};
+
+	void create_target_index_vector(const Labels& labels, const std::vector<std::string>& selected_labels, std::vector<std::ptrdiff_t>& result);
 
 	class CSVReader
 	{
 		// everything public for optimal flexibilty
 	public:
+		// applied to the numbers that are parsed into float: LOG is log2(1 + x), SQRT the square root and ARCSIN5 is
+		// arcsinh(x / 5), all of them keep zero at zero so sparse data stays sparse
 		struct TRANSFORM
 		{
-			enum { NONE, LOG, SQRT, ARCSIN5 };
+			enum Type { NONE, LOG, SQRT, ARCSIN5 };
 		};
 		
 	private:
+		QFile m_file;
+		std::string m_text_buffer;	// only used when the file cannot be memory mapped or has to be decoded
+		std::string_view m_text;	// view on the memory mapped file or on m_text_buffer
+		bool m_text_partial;		// true when only the start of a compressed file is decompressed
 		std::vector<CsvBuffer> m_data;
 		std::string m_column_row_header;
-		std::vector<std::string> m_column_header;
-		std::vector<std::string> m_row_header;
+		Labels m_column_header;
+		Labels m_row_header;
 
 		std::size_t m_nrOfColumns;
 		std::size_t m_nrOfRows;
@@ -56,134 +107,256 @@ namespace ExtCsvLoader
 		char m_separator;
 		bool m_with_column_header;
 		bool m_with_row_header;
+		NumericPolicy m_numeric_policy;
+		TRANSFORM::Type m_transform;
+
+		LoadStats m_stats;
+		ProgressFunction m_progress;
+		bool m_complete;	// true when all rows of the file are read
+		std::atomic<bool> m_cancelled;
+		std::size_t m_reported_rows;	// only used by the thread that reports the progress
 
 		CSVReader() = delete;
+
+		// a compressed file is decompressed into m_text_buffer, only as far as the header and max_rows rows when a sample is read
+		bool open_text(const std::size_t max_rows);
+		// maps every row and column of the file to its index in the result (or -1 when it is not selected)
+		void select_targets(bool transposed, Labels& column_header, Labels& row_header, const std::vector<std::string>& parent_labels, const std::vector<std::string>& dimension_labels, std::vector<std::ptrdiff_t>& target_row_index, std::vector<std::ptrdiff_t>& target_column_index) const;
+		// the selected items of a line as (item, target column) pairs in item order, a line only has to be tokenized up to the last one
+		std::vector<std::pair<std::size_t, std::size_t>> selected_items(const std::vector<std::ptrdiff_t>& target_column_index) const;
+		// counts a finished row of a parallel phase, the thread that started the phase reports the progress now and then
+		void row_done(std::atomic<std::size_t>& rows_done, const std::size_t total, const char* phase);
 	public:
 		explicit CSVReader(const QString& filename, const char separator = ',', bool with_column_header = true, bool with_row_header = true);
 		~CSVReader() = default;
 
 		std::string GetColumnRowHeader() const;
-		const std::vector<std::string>& GetColumnHeader() const;
-		const std::vector<std::string>& GetRowHeader() const;
+		const Labels& GetColumnHeader() const;
+		const Labels& GetRowHeader() const;
 		std::size_t rows() const;
 		std::size_t columns() const;
 
-		void read();
+		void set_numeric_policy(const NumericPolicy& policy);
+		const NumericPolicy& numeric_policy() const;
+
+		void set_transform(TRANSFORM::Type transform);
+		TRANSFORM::Type transform() const;
+		// applies the transform in place to count consecutive values
+		void transform_values(float* values, const std::size_t count) const;
+
+		void set_progress_function(ProgressFunction f);
+		// stops the running phase as soon as possible, can be called from any thread
+		void cancel();
+		bool cancelled() const;
+
+		const LoadStats& stats() const;
+		LoadStats& stats();
+		// updates the peak memory estimate with bytes allocated next to the buffers of the reader itself
+		void note_allocation(const std::size_t bytes);
+
+		// Reads the headers and at most max_rows rows, e.g. a small sample to select the dimensions from. Read at
+		// least one row, it is needed to tell whether the column header lacks the item above the row header.
+		void read(const std::size_t max_rows = std::numeric_limits<std::size_t>::max());
+		bool complete() const;
+		// Parses the selected cells into a row major matrix, one row per entry of row_header. The matrix is
+		// the only copy of the numbers, so it can be moved into the dataset. Empty when nothing is selected
+		// or when the load is cancelled. A float matrix is transformed row by row while it is parsed.
 		template<typename T>
-		T* get_data(bool transposed, std::vector<std::string>& column_header, std::vector<std::string>& row_header, const std::vector<std::string> &parent_labels = {}, const std::vector<std::string> &dimension_labels={});
-		
+		std::vector<T> get_data(bool transposed, Labels& column_header, Labels& row_header, const std::vector<std::string> &parent_labels = {}, const std::vector<std::string> &dimension_labels={});
+
+		// As get_data, but only the cells that are not zero are kept, so the memory it takes scales with the number
+		// of non-zero values instead of with the number of cells. False when nothing is selected or when the load is cancelled.
+		// The values are transformed like those of get_data<float>.
+		bool get_sparse_data(bool transposed, Labels& column_header, Labels& row_header, const std::vector<std::string>& parent_labels, const std::vector<std::string>& dimension_labels, SparseRows& result);
+		// the fraction of the cells in the first max_rows rows that is zero, to tell whether loading them as sparse data pays off
+		double zero_fraction(const std::size_t max_rows);
+
+		// the column_header and row_header that get_data and for_each_cell would give, without visiting any cell
+		void select_labels(bool transposed, Labels& column_header, Labels& row_header, const std::vector<std::string>& parent_labels, const std::vector<std::string>& dimension_labels) const;
+
+		// Calls f(row, column, item) for every selected cell, with row and column as in the result of get_data.
+		// Rows are processed in parallel, so f is called concurrently for different rows. The progress is reported
+		// as phase, when the load is cancelled the remaining rows are skipped. With a row_step above one only every
+		// row_step-th line of the file is visited, e.g. to look at an evenly spread sample of a large file.
+		template<typename CellFunction>
+		void for_each_cell(const char* phase, bool transposed, Labels& column_header, Labels& row_header, const std::vector<std::string>& parent_labels, const std::vector<std::string>& dimension_labels, CellFunction&& f, const std::size_t row_step = 1);
 	};
 
 	template <typename T>
-	T* CSVReader::get_data(bool transposed, std::vector<std::string> &column_header, std::vector<std::string> &row_header, const std::vector<std::string> &parent_labels, const std::vector<std::string> &dimension_labels)
+	std::vector<T> CSVReader::get_data(bool transposed, Labels& column_header, Labels& row_header, const std::vector<std::string> &parent_labels, const std::vector<std::string> &dimension_labels)
 	{
 		assert(m_nrOfRows);
 		assert(m_nrOfColumns);
-		
-		const std::size_t nrOfBufferItems = m_with_row_header ? m_nrOfColumns + 1 : m_nrOfColumns;
 
-		std::vector<std::ptrdiff_t> target_row_index(m_nrOfRows);
-		std::iota(target_row_index.begin(), target_row_index.end(), std::ptrdiff_t(0));
-		std::vector<std::ptrdiff_t> target_column_index(m_nrOfColumns);
-		std::iota(target_column_index.begin(), target_column_index.end(), std::ptrdiff_t(0));
+		std::vector<std::ptrdiff_t> target_row_index;
+		std::vector<std::ptrdiff_t> target_column_index;
+		select_targets(transposed, column_header, row_header, parent_labels, dimension_labels, target_row_index, target_column_index);
+		m_stats.selected_rows = row_header.size();
+		m_stats.selected_columns = column_header.size();
+		const auto items = selected_items(target_column_index);
+		const std::size_t nrOfBufferItems = items.empty() ? 0 : items.back().first + 1;
 
-		if(parent_labels.empty())
-		{
-			column_header = m_column_header;
-			row_header = m_row_header;
-		}
-		else
-		{
+		const std::size_t nrOfTargetColumns = column_header.size();
+		const std::size_t nrOfTargetRows = row_header.size();
+		// wait with data allocation until we are sure about the resulting number of columns and rows
+		
+		const std::size_t totalSize = nrOfTargetColumns * nrOfTargetRows;
+		if (totalSize == 0)
+			return {};
+		const auto start = std::chrono::steady_clock::now();
+		std::vector<T> result(totalSize);
+		T* data = result.data();
+		note_allocation(totalSize * sizeof(T));
 
-			if (transposed && m_with_column_header)
+		std::atomic<std::size_t> rows_done = 0;
+		std::vector<std::chrono::steady_clock::duration> tokenize_time(omp_get_max_threads(), std::chrono::steady_clock::duration::zero());
+		auto parse_row = [&](const std::size_t i, T* row_ptr)
+		{
+			ExtCsvLoader::CsvBuffer& csvbuffer = m_data[i];
+			if (!csvbuffer.processed())
 			{
-				create_target_index_vector(m_column_header, parent_labels, target_column_index);
-				
-				column_header = parent_labels;
-				row_header = m_row_header;
+				const auto tokenize_start = std::chrono::steady_clock::now();
+				csvbuffer.process(m_separator, nrOfBufferItems, nrOfBufferItems);
+				tokenize_time[omp_get_thread_num()] += std::chrono::steady_clock::now() - tokenize_start;
 			}
-			else if (!transposed && m_with_row_header)
+
+			// rows with less items than columns are treated as if the missing items are empty
+			const std::size_t nrOfItems = csvbuffer.size();
+			for (const auto& [item, column_index] : items)
 			{
-				create_target_index_vector(m_row_header, parent_labels, target_row_index);
-				
-				row_header = parent_labels;
-				column_header = m_column_header;
+				const std::string_view text = (item < nrOfItems) ? csvbuffer[item] : std::string_view();
+				if constexpr (std::is_same_v<T, std::string>)
+					row_ptr[column_index] = text;
+				else
+					parse_number(text, row_ptr[column_index], m_numeric_policy);
 			}
-			qDebug() << "parent labels matched";
-		}
-		
+			// every column of the row is filled now and still in cache
+			if constexpr (std::is_same_v<T, float>)
+				transform_values(row_ptr, nrOfTargetColumns);
+			// the items are no longer needed, the line itself can always be processed again
+			csvbuffer.release();
+			row_done(rows_done, nrOfTargetRows, "Parsing");
+		};
 
-		if(!dimension_labels.empty())
+		if (!transposed)
 		{
-			if (!transposed && m_with_column_header)
+			#pragma  omp parallel for schedule(dynamic,1)
+			for (std::ptrdiff_t i = 0; i < (std::ptrdiff_t)m_nrOfRows; ++i)
 			{
-				create_target_index_vector(m_column_header, dimension_labels, target_column_index);
-				
-				column_header = dimension_labels;
+				std::ptrdiff_t row_index = target_row_index[i];
+				if (row_index >= 0 && !cancelled())
+					parse_row(i, data + (row_index * nrOfTargetColumns));
 			}
-
-			qDebug() << "dimension labels matched";
 		}
+		else
+		{
+			// Writing a parsed row straight into its column of the result touches a different cache line (and often page)
+			// for every value. Instead a tile of rows is parsed first and then written out column by column, so every
+			// column of the result receives a run of consecutive values. A tile holds at least a cache line of values per
+			// column and is kept around 1MB when the rows allow it.
+			constexpr std::size_t cache_line = 64;
+			constexpr std::size_t min_tile_rows = std::max<std::size_t>(1, cache_line / sizeof(T));
+			const std::size_t tile_rows = std::clamp<std::size_t>((std::size_t(1) << 20) / (nrOfTargetColumns * sizeof(T)), min_tile_rows, 256);
+			const std::ptrdiff_t nrOfTiles = std::ptrdiff_t((m_nrOfRows + tile_rows - 1) / tile_rows);
+			note_allocation((totalSize + (omp_get_max_threads() * tile_rows * nrOfTargetColumns)) * sizeof(T));
 
-		const std::size_t nrOfTargetColumns = column_header.size();
-		const std::size_t nrOfTargetRows = row_header.size();
-		// wait with data allocation until we are sure about the resulting number of columns and rows
-		
-		const std::size_t totalSize = nrOfTargetColumns * nrOfTargetRows;
-		if (totalSize == 0)
-			return nullptr;
-		T *data = new T[totalSize];
+			#pragma omp parallel
+			{
+				// scratch space per thread, reused for every tile
+				std::vector<T> tile(tile_rows * nrOfTargetColumns);
+				std::vector<std::size_t> tile_row_index(tile_rows);
 
-		#pragma omp parallel
-		{
-			auto tid = omp_get_thread_num();
-			auto chunksize = totalSize / omp_get_num_threads();
-			auto begin = data + chunksize * tid;
-			auto end = (tid == omp_get_num_threads() - 1) ? data+totalSize : (begin + chunksize);
-			std::fill(begin, end, T());
+				#pragma omp for schedule(dynamic,1)
+				for (std::ptrdiff_t t = 0; t < nrOfTiles; ++t)
+				{
+					if (cancelled())
+						continue;
+
+					const std::size_t first_row = std::size_t(t) * tile_rows;
+					const std::size_t last_row = std::min(first_row + tile_rows, m_nrOfRows);
+
+					std::size_t nrOfTileRows = 0;
+					for (std::size_t i = first_row; i < last_row; ++i)
+					{
+						std::ptrdiff_t row_index = target_row_index[i];
+						if (row_index >= 0)
+						{
+							parse_row(i, tile.data() + (nrOfTileRows * nrOfTargetColumns));
+							tile_row_index[nrOfTileRows++] = std::size_t(row_index);
+						}
+					}
+
+					// the tile rows share their cache lines for consecutive columns, so those stay cached while the columns are written
+					for (std::size_t j = 0; j < nrOfTargetColumns; ++j)
+					{
+						T* column_ptr = data + (j * nrOfTargetRows);
+						for (std::size_t k = 0; k < nrOfTileRows; ++k)
+							column_ptr[tile_row_index[k]] = std::move(tile[(k * nrOfTargetColumns) + j]);
+					}
+				}
+			}
 		}
-		 
-		const std::ptrdiff_t column_offset = m_with_row_header ? 1 : 0;
+
+		for (const auto& duration : tokenize_time)
+			m_stats.tokenize_seconds += std::chrono::duration<double>(duration).count();
+		m_stats.parse_seconds += seconds_since(start);
+
+		if (transposed)
+			std::swap(column_header, row_header);
+		if (cancelled())
+			return {};
+		return result;
+	};
+
+	template <typename CellFunction>
+	void CSVReader::for_each_cell(const char* phase, bool transposed, Labels& column_header, Labels& row_header, const std::vector<std::string>& parent_labels, const std::vector<std::string>& dimension_labels, CellFunction&& f, const std::size_t row_step)
+	{
+		std::vector<std::ptrdiff_t> target_row_index;
+		std::vector<std::ptrdiff_t> target_column_index;
+		select_targets(transposed, column_header, row_header, parent_labels, dimension_labels, target_row_index, target_column_index);
+		m_stats.selected_rows = row_header.size();
+		m_stats.selected_columns = column_header.size();
+		const auto items = selected_items(target_column_index);
+		const std::size_t nrOfBufferItems = items.empty() ? 0 : items.back().first + 1;
+
+		const std::size_t step = std::max<std::size_t>(1, row_step);
+		const std::size_t nrOfVisitedRows = (m_nrOfRows + step - 1) / step;
+		const std::size_t nrOfVisitedTargets = (step == 1) ? row_header.size() : nrOfVisitedRows;
+		std::atomic<std::size_t> rows_done = 0;
+		std::vector<std::chrono::steady_clock::duration> tokenize_time(omp_get_max_threads(), std::chrono::steady_clock::duration::zero());
 		#pragma  omp parallel for schedule(dynamic,1)
-		for (std::ptrdiff_t i = 0; i < (std::ptrdiff_t)m_nrOfRows; ++i)
+		for (std::ptrdiff_t v = 0; v < (std::ptrdiff_t)nrOfVisitedRows; ++v)
 		{
+			const std::size_t i = std::size_t(v) * step;
 			std::ptrdiff_t row_index = target_row_index[i];
-			if(row_index >=0)
+			if (row_index >= 0 && !cancelled())
 			{
 				ExtCsvLoader::CsvBuffer& csvbuffer = m_data[i];
 				if (!csvbuffer.processed())
-					csvbuffer.process(m_separator, nrOfBufferItems);
-
-				std::vector<T> transposebuffer;
-				T* row_ptr = data + (row_index * nrOfTargetColumns);
-				if (transposed)
 				{
-					transposebuffer.resize(nrOfTargetColumns);
-					row_ptr = &(transposebuffer[0]);
+					const auto tokenize_start = std::chrono::steady_clock::now();
+					csvbuffer.process(m_separator, nrOfBufferItems, nrOfBufferItems);
+					tokenize_time[omp_get_thread_num()] += std::chrono::steady_clock::now() - tokenize_start;
 				}
 
-				for (std::size_t j = 0; j < m_nrOfColumns; ++j)
+				// rows with less items than columns are padded with empty items
+				const std::size_t nrOfItems = csvbuffer.size();
+				for (const auto& [item, column_index] : items)
 				{
-					auto column_index = target_column_index[j];
-					if (column_index >= 0)
-						csvbuffer.getAs(j + column_offset, row_ptr[column_index]);
-				}
-
-				if (transposed)
-				{
-					for (std::size_t j = 0; j < nrOfTargetColumns; ++j)
-					{
-						data[(j * nrOfTargetRows) + row_index] = row_ptr[j];
-					}
+					const std::string_view text = (item < nrOfItems) ? csvbuffer[item] : std::string_view();
+					if (transposed)
+						f(column_index, std::size_t(row_index), text);
+					else
+						f(std::size_t(row_index), column_index, text);
 				}
+				csvbuffer.release();
+				row_done(rows_done, nrOfVisitedTargets, phase);
 			}
 		}
+		for (const auto& duration : tokenize_time)
+			m_stats.tokenize_seconds += std::chrono::duration<double>(duration).count();
 
 		if (transposed)
 			std::swap(column_header, row_header);
-		return data;
-	};
-
-
+	}
 }
-
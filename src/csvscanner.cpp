@@ -0,0 +1,132 @@
+#include "csvscanner.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define EXTCSVLOADER_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(EXTCSVLOADER_X86) && !defined(_MSC_VER)
+#define EXTCSVLOADER_TARGET_AVX2 __attribute__((target("avx2")))
+#define EXTCSVLOADER_TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define EXTCSVLOADER_TARGET_AVX2
+#define EXTCSVLOADER_TARGET_SSE2
+#endif
+
+namespace ExtCsvLoader
+{
+	namespace
+	{
+		std::uint64_t match_mask_scalar(const char* data, std::size_t length, char a, char b)
+		{
+			std::uint64_t mask = 0;
+			for (std::size_t i = 0; i < length; ++i)
+			{
+				const char c = data[i];
+				mask |= std::uint64_t((c == a) | (c == b)) << i;
+			}
+			return mask;
+		}
+
+#ifdef EXTCSVLOADER_X86
+		EXTCSVLOADER_TARGET_SSE2
+		std::uint64_t match_mask_sse2(const char* data, std::size_t length, char a, char b)
+		{
+			if (length < 64)
+				return match_mask_scalar(data, length, a, b);
+
+			const __m128i va = _mm_set1_epi8(a);
+			const __m128i vb = _mm_set1_epi8(b);
+			std::uint64_t mask = 0;
+			for (int i = 0; i < 4; ++i)
+			{
+				const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * i));
+				const __m128i match = _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb));
+				mask |= std::uint64_t(std::uint16_t(_mm_movemask_epi8(match))) << (16 * i);
+			}
+			return mask;
+		}
+
+		EXTCSVLOADER_TARGET_AVX2
+		std::uint64_t match_mask_avx2(const char* data, std::size_t length, char a, char b)
+		{
+			if (length < 64)
+				return match_mask_scalar(data, length, a, b);
+
+			const __m256i va = _mm256_set1_epi8(a);
+			const __m256i vb = _mm256_set1_epi8(b);
+			const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+			const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 32));
+			const __m256i match_lo = _mm256_or_si256(_mm256_cmpeq_epi8(lo, va), _mm256_cmpeq_epi8(lo, vb));
+			const __m256i match_hi = _mm256_or_si256(_mm256_cmpeq_epi8(hi, va), _mm256_cmpeq_epi8(hi, vb));
+			return std::uint64_t(std::uint32_t(_mm256_movemask_epi8(match_lo))) | (std::uint64_t(std::uint32_t(_mm256_movemask_epi8(match_hi))) << 32);
+		}
+
+		bool cpu_supports_avx2()
+		{
+#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7)
+				return false;
+			__cpuid(info, 1);
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+			if (!osxsave || ((_xgetbv(0) & 0x6) != 0x6)) // the os has to save the ymm registers
+				return false;
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+#else
+			return __builtin_cpu_supports("avx2");
+#endif
+		}
+#endif
+
+		struct MatchMaskImplementation
+		{
+			MatchMaskFunction function;
+			const char* name;
+		};
+
+		MatchMaskImplementation select_implementation()
+		{
+#ifdef EXTCSVLOADER_X86
+			if (cpu_supports_avx2())
+				return { match_mask_avx2, "AVX2" };
+			return { match_mask_sse2, "SSE2" };
+#else
+			return { match_mask_scalar, "scalar" };
+#endif
+		}
+
+		const MatchMaskImplementation& implementation()
+		{
+			static const MatchMaskImplementation selected = select_implementation();
+			return selected;
+		}
+	}
+
+	MatchMaskFunction match_mask_function()
+	{
+		return implementation().function;
+	}
+
+	const char* match_mask_function_name()
+	{
+		return implementation().name;
+	}
+
+	std::size_t count_matches(std::string_view text, const char c)
+	{
+		const MatchMaskFunction match_mask = match_mask_function();
+		std::size_t count = 0;
+		for (std::size_t block = 0; block < text.size(); block += 64)
+		{
+			const std::size_t length = (text.size() - block < 64) ? (text.size() - block) : 64;
+			count += std::popcount(match_mask(text.data() + block, length, c, c));
+		}
+		return count;
+	}
+}
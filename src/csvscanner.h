@@ -0,0 +1,47 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+namespace ExtCsvLoader
+{
+	// Returns a mask in which bit i is set when data[i] equals a or b. Only the first length (at most 64) characters are tested.
+	using MatchMaskFunction = std::uint64_t(*)(const char* data, std::size_t length, char a, char b);
+
+	// The fastest implementation supported by the cpu we are running on (AVX2, SSE2 or scalar), selected once at runtime.
+	MatchMaskFunction match_mask_function();
+	const char* match_mask_function_name();
+
+	// Calls f(position) for every character in text that equals a or b, in increasing order of position.
+	// When f returns a bool, returning false stops the scan.
+	template <typename Function>
+	void for_each_match(std::string_view text, const char a, const char b, Function&& f)
+	{
+		static const MatchMaskFunction match_mask = match_mask_function();
+
+		const char* data = text.data();
+		const std::size_t size = text.size();
+		for (std::size_t block = 0; block < size; block += 64)
+		{
+			const std::size_t length = (size - block < 64) ? (size - block) : 64;
+			for (std::uint64_t mask = match_mask(data + block, length, a, b); mask != 0; mask &= mask - 1)
+			{
+				if constexpr (std::is_same_v<std::invoke_result_t<Function&, std::size_t>, bool>)
+				{
+					if (!f(block + std::countr_zero(mask)))
+						return;
+				}
+				else
+				{
+					f(block + std::countr_zero(mask));
+				}
+			}
+		}
+	}
+
+	// Number of characters in text that equal c.
+	std::size_t count_matches(std::string_view text, const char c);
+}